@@ -11,15 +11,26 @@ HEADERS += \
     videoprovider.h \
     glwidget.h \
     progressslider.h \
-    accuratetimer.h \
 #    audiooutput_qaudiooutput.h \
     smartmutex.h \
     avdecodercore.h \
     avplaycontrol.h \
     videodecoderbuffer.h \
     audioplayerbase.h \
-    audioplayer_directsound.h \
-    audiodecoderbuffer.h
+    audioplayerfactory.h \
+    audioplayer_null.h \
+    audioplayer_wav.h \
+    audiodecoderbuffer.h \
+    keyframeindex.h \
+    avobjectpool.h \
+    audioringbuffer.h \
+    spscqueue.h \
+    decodercommandqueue.h \
+    iointerrupter.h \
+    pixelbufferuploader.h \
+    avclock.h \
+    deadlinetimer.h \
+    videopresenter.h
 
 SOURCES += main.cpp \
     bufimage.cpp \
@@ -28,20 +39,38 @@ SOURCES += main.cpp \
     videoprovider.cpp \
     glwidget.cpp \
     progressslider.cpp \
-    accuratetimer.cpp \
 #    audiooutput_qaudiooutput.cpp \
     avdecodercore.cpp \
 #    videooutput.cpp \
     avplaycontrol.cpp \
     videodecoderbuffer.cpp \
     audioplayerbase.cpp \
-    audioplayer_directsound.cpp \
-    audiodecoderbuffer.cpp
+    audioplayerfactory.cpp \
+    audioplayer_null.cpp \
+    audioplayer_wav.cpp \
+    audiodecoderbuffer.cpp \
+    keyframeindex.cpp \
+    audioringbuffer.cpp \
+    decodercommandqueue.cpp \
+    pixelbufferuploader.cpp \
+    avclock.cpp \
+    deadlinetimer.cpp \
+    videopresenter.cpp
 
 win32: {
 HEADERS += \
+    audioplayer_directsound.h
 
 SOURCES += \
+    audioplayer_directsound.cpp
+}
+
+unix: {
+HEADERS += \
+    audioplayer_alsa.h
+
+SOURCES += \
+    audioplayer_alsa.cpp
 }
 
 #unix: {
@@ -1,6 +1,9 @@
 #include "audiodecoderbuffer.h"
 #include "smartmutex.h"
 
+// capacity of the sample buffer, in seconds of output
+#define AUDIO_RING_BUFFER_DURATION  1.0
+
 AudioDecoderBuffer::AudioDecoderBuffer(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent)
     : QObject(parent)
     , m_decoderCore(decoder)
@@ -8,12 +11,16 @@ AudioDecoderBuffer::AudioDecoderBuffer(AVDecoderCore *decoder, int audioStreamIn
     , m_isDecodeEnd(false)
     , m_isSeeking(false)
     , m_bufferMinSize(0)
-    , m_dataMtx(QMutex::Recursive)
+    , m_bufferMinDuration(0.0)
     , m_opeMtx(QMutex::Recursive)
 {
     moveToThread(&m_thread);
 
     if (isAvailable()) {
+        int bytesPerFrame = m_decoderCore->getAudioOutputBytesPerFrame(m_enabledAudioStreamIndex);
+        int bytesPerSecond = m_decoderCore->getAudioOutputBytesPerSecond(m_enabledAudioStreamIndex);
+        m_ringBuffer.allocate(bytesPerSecond * AUDIO_RING_BUFFER_DURATION, bytesPerFrame, bytesPerSecond);
+
         m_thread.start();
         QMetaObject::invokeMethod(this, "handleRequests");
         requestDecode();
@@ -58,9 +65,7 @@ void AudioDecoderBuffer::resetDecoder()
     m_decoderCore->seekAudio(m_enabledAudioStreamIndex, 0);
     setDecodeEnd(false);
 
-    m_dataMtx.lock();
-    m_bufferedDatas.clear();
-    m_dataMtx.unlock();
+    m_ringBuffer.clear();
     requestDecode();
 }
 
@@ -69,7 +74,6 @@ bool AudioDecoderBuffer::seek(double time)
     if (!isAvailable()) {
         return false;
     }
-    removeDecodeRequests();
     requestSeekAudio(time);
     return true;
 }
@@ -84,6 +88,9 @@ void AudioDecoderBuffer::setBufferMinSize(int size)
     if (size < 0) {
         return;
     }
+    if (size > m_ringBuffer.getCapacity()) {
+        size = m_ringBuffer.getCapacity();
+    }
     m_bufferMinSize = size;
     if (!isBuffered()) {
         requestDecode();
@@ -95,70 +102,72 @@ int AudioDecoderBuffer::getBufferMinSize()
     return m_bufferMinSize;
 }
 
+void AudioDecoderBuffer::setBufferMinDuration(double duration)
+{
+    if (duration < 0.0) {
+        return;
+    }
+    double capacity = (double)m_ringBuffer.getCapacity() / qMax(1, m_ringBuffer.getBytesPerSecond());
+    if (duration > capacity) {
+        duration = capacity;
+    }
+    m_bufferMinDuration = duration;
+    if (!isBuffered()) {
+        requestDecode();
+    }
+}
+
+double AudioDecoderBuffer::getBufferMinDuration()
+{
+    return m_bufferMinDuration;
+}
+
 int AudioDecoderBuffer::getBufferSize()
 {
     if (!isAvailable()) {
         return 0;
     }
-
-    SmartMutex dataMtx(&m_dataMtx);
-    quint32 size = 0;
-    foreach (AudioData ad, m_bufferedDatas) {
-        size += ad.data.size();
-    }
-    return size;
+    return m_ringBuffer.getReadableSize();
 }
 
-bool AudioDecoderBuffer::isBuffered()
+double AudioDecoderBuffer::getBufferDuration()
 {
     if (!isAvailable()) {
-        return false;
+        return 0.0;
     }
-
-    int size = getBufferSize();
-    return (m_bufferMinSize == 0) ? (size > 0) : (size >= m_bufferMinSize);
+    return m_ringBuffer.getReadableDuration();
 }
 
-bool AudioDecoderBuffer::hasBufferedData()
+bool AudioDecoderBuffer::isBuffered()
 {
     if (!isAvailable()) {
         return false;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
-    return !m_bufferedDatas.isEmpty();
+    int minSize = qMax(m_bufferMinSize, (int)(m_bufferMinDuration * m_ringBuffer.getBytesPerSecond()));
+    int size = m_ringBuffer.getReadableSize();
+    return (minSize == 0) ? (size > 0) : (size >= minSize);
 }
 
-AudioDecoderBuffer::AudioData AudioDecoderBuffer::getBufferedData()
+bool AudioDecoderBuffer::hasBufferedData()
 {
-    AudioData ad;
     if (!isAvailable()) {
-        return ad;
-    }
-
-    SmartMutex dataMtx(&m_dataMtx);
-    if (!m_bufferedDatas.isEmpty()) {
-        ad = m_bufferedDatas.front();
+        return false;
     }
-    return ad;
+    return m_ringBuffer.getReadableSize() > 0;
 }
 
-AudioDecoderBuffer::AudioData AudioDecoderBuffer::popBufferedData()
+int AudioDecoderBuffer::readBufferedData(char *data, int maxSize, double &time)
 {
-    AudioData ad;
     if (!isAvailable()) {
-        return ad;
+        return 0;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
-    if (!m_bufferedDatas.isEmpty()) {
-        ad = m_bufferedDatas.front();
-        m_bufferedDatas.pop_front();
-        if (!isBuffered()) {
-            requestDecode();
-        }
+    int size = m_ringBuffer.read(data, maxSize, time);
+    if (!isBuffered()) {
+        requestDecode();
     }
-    return ad;
+    return size;
 }
 
 void AudioDecoderBuffer::setDecodeEnd(bool isDecodeEnd)
@@ -181,29 +190,19 @@ void AudioDecoderBuffer::setSeekingState(bool isSeeking)
 void AudioDecoderBuffer::handleRequests()
 {
     while (1) {
-        m_reqMtx.lock();
-        if (m_requestList.isEmpty()) {
-            m_cond.wait(&m_reqMtx);
-            m_reqMtx.unlock();
-            continue;
-        }
-        Request req = m_requestList.front();
-        m_requestList.pop_front();
-        m_reqMtx.unlock();
+        DecoderCommand cmd = m_commands.take();
 
-        switch (req.rid) {
-        case REQUEST_DECODE:
-            doDecode();
+        switch (cmd.type) {
+        case DecoderCommand::DECODE:
+            doDecode(cmd.token);
             break;
 
-        case REQUEST_SEEK:
-            doSeek(req.p1.toDouble());
+        case DecoderCommand::SEEK:
+            doSeek(cmd.pos, cmd.token);
             break;
 
-        case REQUEST_QUIT:
-            m_reqMtx.lock();
-            m_requestList.clear();
-            m_reqMtx.unlock();
+        case DecoderCommand::QUIT:
+            m_commands.clear();
             return;
 
         default:
@@ -212,54 +211,24 @@ void AudioDecoderBuffer::handleRequests()
     }
 }
 
-void AudioDecoderBuffer::pushRequest(const Request &req)
-{
-    m_reqMtx.lock();
-    m_requestList.push_back(req);
-    m_cond.wakeAll();
-    m_reqMtx.unlock();
-}
-
-void AudioDecoderBuffer::clearRequestList()
-{
-    m_reqMtx.lock();
-    m_requestList.clear();
-    m_reqMtx.unlock();
-}
-
-void AudioDecoderBuffer::removeDecodeRequests()
-{
-    m_reqMtx.lock();
-    for (QList<Request>::iterator it = m_requestList.begin(); it != m_requestList.end(); ) {
-        if (it->rid == REQUEST_DECODE) {
-            it = m_requestList.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
-    m_reqMtx.unlock();
-}
-
-void AudioDecoderBuffer::requestDecode(QVariant p)
+void AudioDecoderBuffer::requestDecode()
 {
-    Request req(REQUEST_DECODE, p);
-    pushRequest(req);
+    // called by the audio output after every read, the queue keeps one at a
+    // time and rarely has to touch its mutex for it
+    m_commands.push(DecoderCommand::decode());
 }
 
 void AudioDecoderBuffer::requestSeekAudio(double pos)
 {
-    Request req(REQUEST_SEEK, pos);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::seek(m_enabledAudioStreamIndex, pos));
 }
 
 void AudioDecoderBuffer::requestQuit()
 {
-    Request req(REQUEST_QUIT);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::quit());
 }
 
-void AudioDecoderBuffer::doDecode()
+void AudioDecoderBuffer::doDecode(int token)
 {
     if (!isAvailable()) {
         return;
@@ -273,14 +242,19 @@ void AudioDecoderBuffer::doDecode()
 
     SmartMutex opeMtx(&m_opeMtx);
     while (1) {
-        if (isBuffered()) {
+        if (isBuffered() || m_ringBuffer.getWritableSize() == 0) {
             emit audioDataBuffered();
             return;
         }
+        if (m_commands.isCanceled(token)) {
+            return;
+        }
 
-        QByteArray data;
-        double pts, duration;
-        int averr = m_decoderCore->getAudioNextFrame(m_enabledAudioStreamIndex, data, pts, duration);
+        int averr = m_decoderCore->getAudioNextFrame(m_enabledAudioStreamIndex, &m_ringBuffer);
+        if (averr == AVERROR_EXIT) {
+            // interrupted for a newer seek, not the end of the file
+            return;
+        }
         if (averr != 0) {
             qDebug() <<  __PRETTY_FUNCTION__ << "cannot get next frame";
             setDecodeEnd(true);
@@ -288,18 +262,10 @@ void AudioDecoderBuffer::doDecode()
         }
 
         setDecodeEnd(false);
-
-        AudioData vd;
-        vd.data = data;
-        vd.time = pts;
-        vd.duration = duration;
-        m_dataMtx.lock();
-        m_bufferedDatas.push_back(vd);
-        m_dataMtx.unlock();
     }
 }
 
-void AudioDecoderBuffer::doSeek(double pos)
+void AudioDecoderBuffer::doSeek(double pos, int token)
 {
     if (pos < 0) {
         return;
@@ -308,9 +274,7 @@ void AudioDecoderBuffer::doSeek(double pos)
         return;
     }
 
-    m_dataMtx.lock();
-    m_bufferedDatas.clear();
-    m_dataMtx.unlock();
+    m_ringBuffer.clear();
 
     setSeekingState(true);
 
@@ -321,8 +285,11 @@ void AudioDecoderBuffer::doSeek(double pos)
     qDebug() <<  __PRETTY_FUNCTION__ << "cost" << t.elapsed() << "ms";
     t.start();
     setDecodeEnd(false);
-    doDecode();
+    doDecode(token);
     qDebug() <<  __PRETTY_FUNCTION__ << "cost" << t.elapsed() << "ms";
 
+    if (m_commands.isCanceled(token)) {
+        return;
+    }
     setSeekingState(false);
 }
@@ -2,6 +2,7 @@
 #define AUDIODECODERBUFFER_H
 
 #include "avdecodercore.h"
+#include "decodercommandqueue.h"
 
 class AudioDecoderBuffer : public QObject
 {
@@ -13,13 +14,6 @@ public:
         DECODING_END,
     };
 
-    struct AudioData {
-        QByteArray data;
-        double time, duration;
-
-        AudioData() : time(0.0), duration(0.0) {}
-    };
-
 public:
     explicit AudioDecoderBuffer(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent = 0);
 
@@ -32,46 +26,35 @@ public:
     bool seek(double time);
     bool isSeeking();
 
+    // buffered once both the byte and the duration thresholds are reached
     void setBufferMinSize(int size);
     int getBufferMinSize();
+    void setBufferMinDuration(double duration);
+    double getBufferMinDuration();
     int getBufferSize();
+    double getBufferDuration();
     bool isBuffered();
     bool hasBufferedData();
-    AudioData getBufferedData();
-    AudioData popBufferedData();
+    // copy out up to maxSize bytes, time is the timestamp of the first one
+    int readBufferedData(char *data, int maxSize, double &time);
 
 signals:
     void audioDataBuffered();
     void seekingStateChanged(bool isSeeking);
 
 protected:
-    enum REQUEST_ID {
-        REQUEST_DECODE,
-        REQUEST_SEEK,
-        REQUEST_QUIT,
-    };
-
-    struct Request {
-        Request(REQUEST_ID _rid, QVariant _p = QVariant()) : rid(_rid), p1(_p) {}
-        REQUEST_ID rid;
-        QVariant   p1;
-    };
-
     void setDecodeEnd(bool isDecodeEnd);
     void setSeekingState(bool isSeeking);
 
     Q_INVOKABLE void handleRequests();
 
-    void pushRequest(const Request &req);
-    void clearRequestList();
-    void removeDecodeRequests();
-
-    void requestDecode(QVariant p = QVariant());
+    void requestDecode();
     void requestSeekAudio(double pos);
     void requestQuit();
 
-    void doDecode();
-    void doSeek(double pos);
+    // token is the one of the command being run, 0 never gets canceled
+    void doDecode(int token = 0);
+    void doSeek(double pos, int token);
 
 private:
     AVDecoderCore *m_decoderCore;
@@ -80,13 +63,14 @@ private:
     bool m_isSeeking;
 
     QThread m_thread;
-    QList<Request> m_requestList;
+    DecoderCommandQueue m_commands;
 
-    QList<AudioData> m_bufferedDatas;
+    // filled by the decode thread, drained by the audio output thread
+    AudioRingBuffer m_ringBuffer;
     int m_bufferMinSize;
+    double m_bufferMinDuration;
 
-    QMutex m_reqMtx, m_dataMtx, m_opeMtx;
-    QWaitCondition m_cond;
+    QMutex m_opeMtx;
 };
 
 #endif // AUDIODECODERBUFFER_H
@@ -0,0 +1,360 @@
+#include "audioplayer_alsa.h"
+#include "smartmutex.h"
+
+#include <poll.h>
+
+#define DEFAULT_DEVICE          "default"
+// of the device ring, in microseconds
+#define DEFAULT_PERIOD_TIME     10000
+#define DEFAULT_BUFFER_TIME     40000
+
+AudioPlayer_Alsa::AudioPlayer_Alsa(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent)
+    : AudioPlayerBase(decoder, audioStreamIndex, parent)
+    , m_taskid(0)
+    , m_device(DEFAULT_DEVICE)
+    , m_periodTime(DEFAULT_PERIOD_TIME)
+    , m_bufferTime(DEFAULT_BUFFER_TIME)
+{
+    moveToThread(&m_thread);
+
+    if (isAvailable()) {
+        m_thread.start();
+
+        connect(&m_decoderBuffer, SIGNAL(seekingStateChanged(bool)),
+                this, SLOT(onDecoderSeekingStateChanged(bool)), Qt::DirectConnection);
+    }
+}
+
+AudioPlayer_Alsa::~AudioPlayer_Alsa()
+{
+    stop();
+
+    if (m_thread.isRunning()) {
+        m_thread.quit();
+        m_thread.wait();
+    }
+}
+
+bool AudioPlayer_Alsa::isAvailable()
+{
+    return isDecoderAvailable();
+}
+
+void AudioPlayer_Alsa::play()
+{
+    if (isPlaying()) {
+        return;
+    }
+    if (!isAvailable()) {
+        return;
+    }
+
+    if (m_decoderBuffer.isDecodeEnd()) {
+        m_decoderBuffer.resetDecoder();
+    }
+    QMetaObject::invokeMethod(this, "outputAudioData", Q_ARG(int,++m_taskid));
+}
+
+void AudioPlayer_Alsa::stop()
+{
+    ++m_taskid;
+}
+
+void AudioPlayer_Alsa::seek(double pos)
+{
+    if (pos < 0.0) {
+        return;
+    }
+    if (!isAvailable()) {
+        return;
+    }
+    SmartMutex mtx(&m_mtx);
+    if (!m_decoderBuffer.seek(pos)) {
+        return;
+    }
+    resetClock(pos);
+    setSeekingState(true);
+}
+
+void AudioPlayer_Alsa::setDevice(const QString &device)
+{
+    if (device.isEmpty()) {
+        return;
+    }
+    SmartMutex mtx(&m_mtx);
+    m_device = device;
+}
+
+QString AudioPlayer_Alsa::getDevice()
+{
+    SmartMutex mtx(&m_mtx);
+    return m_device;
+}
+
+void AudioPlayer_Alsa::setPeriodTime(int time)
+{
+    if (time <= 0) {
+        return;
+    }
+    m_periodTime.store(time);
+}
+
+int AudioPlayer_Alsa::getPeriodTime()
+{
+    return m_periodTime.load();
+}
+
+void AudioPlayer_Alsa::setBufferTime(int time)
+{
+    if (time <= 0) {
+        return;
+    }
+    m_bufferTime.store(time);
+}
+
+int AudioPlayer_Alsa::getBufferTime()
+{
+    return m_bufferTime.load();
+}
+
+void AudioPlayer_Alsa::onDecoderSeekingStateChanged(bool isSeeking)
+{
+    m_mtx.lock();
+    setSeekingState(isSeeking);
+    m_mtx.unlock();
+}
+
+void AudioPlayer_Alsa::outputAudioData(int taskid)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "start";
+
+    if (!isAvailable()) {
+        return;
+    }
+
+    AVSampleFormat sampleFormat = m_avdecoder->getAudioOutputSampleFormat(m_enabledAudioStreamIndex);
+    int sampleRate = m_avdecoder->getAudioOutputSampleRate(m_enabledAudioStreamIndex);
+    int channels = m_avdecoder->getAudioOutputChannels(m_enabledAudioStreamIndex);
+    int bytesPerSample = m_avdecoder->getAudioOutputBytesPerSample(m_enabledAudioStreamIndex);
+    int bytesPerFrame = m_avdecoder->getAudioOutputBytesPerFrame(m_enabledAudioStreamIndex);
+    int bytesPerSecond = m_avdecoder->getAudioOutputBytesPerSecond(m_enabledAudioStreamIndex);
+    qDebug() << __PRETTY_FUNCTION__ << "sample rate:" << sampleRate;
+    qDebug() << __PRETTY_FUNCTION__ << "channels:" << channels;
+    qDebug() << __PRETTY_FUNCTION__ << "bytes per frame:" << bytesPerFrame;
+
+    snd_pcm_format_t pcmFormat = SND_PCM_FORMAT_UNKNOWN;
+    snd_pcm_t *pcm = 0;
+    snd_pcm_hw_params_t *hwp = 0;
+    snd_pcm_sw_params_t *swp = 0;
+    unsigned int rate = sampleRate;
+    QByteArray device = getDevice().toLocal8Bit();
+    unsigned int periodTime = getPeriodTime(), bufferTime = getBufferTime();
+    snd_pcm_uframes_t periodFrames = 0, bufferFrames = 0;
+    int dir = 0;
+    QVector<struct pollfd> fds;
+    int ret;
+
+    switch (sampleFormat) {
+    case AV_SAMPLE_FMT_U8:
+        pcmFormat = SND_PCM_FORMAT_U8;
+        break;
+    case AV_SAMPLE_FMT_S16:
+        pcmFormat = SND_PCM_FORMAT_S16;
+        break;
+    case AV_SAMPLE_FMT_S32:
+        pcmFormat = SND_PCM_FORMAT_S32;
+        break;
+    default:
+        qDebug() << __PRETTY_FUNCTION__ << "unsupported sample format:" << av_get_sample_fmt_name(sampleFormat);
+        goto END;
+    }
+
+    // nonblocking, poll() does the waiting
+    ret = snd_pcm_open(&pcm, device.constData(), SND_PCM_STREAM_PLAYBACK, SND_PCM_NONBLOCK);
+    if (ret < 0) {
+        qDebug() << "snd_pcm_open():" << device << snd_strerror(ret);
+        pcm = 0;
+        goto END;
+    }
+
+    if ((ret = snd_pcm_hw_params_malloc(&hwp)) < 0
+            || (ret = snd_pcm_hw_params_any(pcm, hwp)) < 0) {
+        qDebug() << "snd_pcm_hw_params_any():" << snd_strerror(ret);
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params_set_access(pcm, hwp, SND_PCM_ACCESS_MMAP_INTERLEAVED)) < 0) {
+        qDebug() << "snd_pcm_hw_params_set_access(): mmap interleaved:" << snd_strerror(ret);
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params_set_format(pcm, hwp, pcmFormat)) < 0) {
+        qDebug() << "snd_pcm_hw_params_set_format():" << snd_strerror(ret);
+        goto END;
+    }
+    // the samples are copied as they are, the layout has to match
+    if ((ret = snd_pcm_hw_params_set_channels(pcm, hwp, channels)) < 0) {
+        qDebug() << "snd_pcm_hw_params_set_channels():" << channels << snd_strerror(ret);
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params_set_rate_near(pcm, hwp, &rate, 0)) < 0 || (int)rate != sampleRate) {
+        qDebug() << "snd_pcm_hw_params_set_rate_near(): expect:" << sampleRate << "actual:" << rate;
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params_set_buffer_time_near(pcm, hwp, &bufferTime, &dir)) < 0) {
+        qDebug() << "snd_pcm_hw_params_set_buffer_time_near():" << snd_strerror(ret);
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params_set_period_time_near(pcm, hwp, &periodTime, &dir)) < 0) {
+        qDebug() << "snd_pcm_hw_params_set_period_time_near():" << snd_strerror(ret);
+        goto END;
+    }
+    if ((ret = snd_pcm_hw_params(pcm, hwp)) < 0) {
+        qDebug() << "snd_pcm_hw_params():" << snd_strerror(ret);
+        goto END;
+    }
+    snd_pcm_hw_params_get_buffer_size(hwp, &bufferFrames);
+    snd_pcm_hw_params_get_period_size(hwp, &periodFrames, &dir);
+    qDebug() << __PRETTY_FUNCTION__ << "buffer time:" << bufferTime << "period time:" << periodTime
+             << "buffer frames:" << bufferFrames << "period frames:" << periodFrames;
+
+    // woken up for every free period, started once the first one is written
+    if ((ret = snd_pcm_sw_params_malloc(&swp)) < 0
+            || (ret = snd_pcm_sw_params_current(pcm, swp)) < 0
+            || (ret = snd_pcm_sw_params_set_avail_min(pcm, swp, periodFrames)) < 0
+            || (ret = snd_pcm_sw_params_set_start_threshold(pcm, swp, periodFrames)) < 0
+            || (ret = snd_pcm_sw_params(pcm, swp)) < 0) {
+        qDebug() << "snd_pcm_sw_params():" << snd_strerror(ret);
+        goto END;
+    }
+
+    fds.resize(snd_pcm_poll_descriptors_count(pcm));
+    if (fds.isEmpty() || snd_pcm_poll_descriptors(pcm, fds.data(), fds.count()) < 0) {
+        qDebug() << "snd_pcm_poll_descriptors(): none";
+        goto END;
+    }
+
+    m_decoderBuffer.setBufferMinDuration(periodTime / 1000000.0 * 4);
+    setPlaybackState(true);
+
+    while (taskid == m_taskid) {
+        if (!m_decoderBuffer.hasBufferedData()
+                && m_decoderBuffer.isDecodeEnd()) {
+            // let the queued samples play out
+            snd_pcm_nonblock(pcm, 0);
+            snd_pcm_drain(pcm);
+            setPlaybackState(false);
+            break;
+        }
+
+        snd_pcm_sframes_t avail = snd_pcm_avail_update(pcm);
+        if (avail < 0) {
+            if (!recover(pcm, avail)) {
+                break;
+            }
+            continue;
+        }
+        if (avail < (snd_pcm_sframes_t)periodFrames) {
+            // a period of timeout, so a stop() does not wait for long
+            poll(fds.data(), fds.count(), periodTime / 1000 * 2 + 1);
+            unsigned short revents = 0;
+            snd_pcm_poll_descriptors_revents(pcm, fds.data(), fds.count(), &revents);
+            if (revents & POLLERR) {
+                if (!recover(pcm, snd_pcm_state(pcm) == SND_PCM_STATE_SUSPENDED ? -ESTRPIPE : -EPIPE)) {
+                    break;
+                }
+            }
+            continue;
+        }
+
+        snd_pcm_uframes_t committed = 0;
+        {
+            SmartMutex mtx(&m_mtx);
+
+            const snd_pcm_channel_area_t *areas = 0;
+            snd_pcm_uframes_t offset = 0, frames = avail;
+            ret = snd_pcm_mmap_begin(pcm, &areas, &offset, &frames);
+            if (ret < 0) {
+                if (!recover(pcm, ret)) {
+                    break;
+                }
+                continue;
+            }
+
+            // interleaved, the frames of the ring are contiguous from offset on
+            char *dst = (char*)areas[0].addr + areas[0].first / 8 + offset * areas[0].step / 8;
+            int size = frames * bytesPerFrame;
+            double pos = 0.0, time = 0.0;
+            int r = 0;
+            if (!m_isSeeking) {
+                r = m_decoderBuffer.readBufferedData(dst, size, time);
+                if (r > 0) {
+                    pos = time + (double)r / bytesPerSecond;
+                }
+                else {
+                    r = 0;
+                }
+            }
+
+            if (r > 0) {
+                committed = (r + bytesPerFrame - 1) / bytesPerFrame;
+            }
+            else if (bufferFrames - (snd_pcm_uframes_t)avail < periodFrames) {
+                // nothing decoded, a period of silence keeps the device from running dry
+                committed = qMin(frames, periodFrames);
+            }
+            if ((int)committed * bytesPerFrame > r) {
+                snd_pcm_format_set_silence(pcmFormat, dst + r, ((int)committed * bytesPerFrame - r) / bytesPerSample);
+            }
+
+            snd_pcm_sframes_t c = snd_pcm_mmap_commit(pcm, offset, committed);
+            if (c < 0 || (snd_pcm_uframes_t)c != committed) {
+                if (!recover(pcm, c >= 0 ? -EPIPE : c)) {
+                    break;
+                }
+                continue;
+            }
+
+            // the device is not counting down before it runs
+            if (r > 0 && snd_pcm_state(pcm) == SND_PCM_STATE_RUNNING) {
+                snd_pcm_sframes_t delay = 0;
+                if (snd_pcm_delay(pcm, &delay) == 0) {
+                    updateClock(pos, (double)delay / sampleRate);
+                }
+            }
+            setPosition(getClock());
+        }
+
+        if (committed == 0) {
+            // waiting for the decoder, the device still has enough queued
+            QThread::usleep(periodTime / 2);
+        }
+    }
+
+END:
+    if (pcm) {
+        snd_pcm_drop(pcm);
+        snd_pcm_close(pcm);
+    }
+    if (swp) {
+        snd_pcm_sw_params_free(swp);
+    }
+    if (hwp) {
+        snd_pcm_hw_params_free(hwp);
+    }
+
+    setPlaybackState(false);
+    setSeekingState(false);
+
+    qDebug() << __PRETTY_FUNCTION__ << "end";
+}
+
+bool AudioPlayer_Alsa::recover(snd_pcm_t *pcm, int err)
+{
+    qDebug() << __PRETTY_FUNCTION__ << (err == -EPIPE ? "underrun" : snd_strerror(err));
+    // prepares again after an underrun, resumes after a suspend
+    int ret = snd_pcm_recover(pcm, err, 1);
+    if (ret < 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "cannot recover:" << snd_strerror(ret);
+        return false;
+    }
+    return true;
+}
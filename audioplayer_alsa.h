@@ -0,0 +1,50 @@
+#ifndef AUDIOPLAYER_ALSA_H
+#define AUDIOPLAYER_ALSA_H
+
+#include <alsa/asoundlib.h>
+
+#include <QtCore>
+
+#include "audioplayerbase.h"
+#include "audiodecoderbuffer.h"
+
+// ALSA output writing the decoded samples straight into the mmap'ed ring of
+// the device, woken up by poll() once a period is free.
+class AudioPlayer_Alsa : public AudioPlayerBase
+{
+    Q_OBJECT
+public:
+    explicit AudioPlayer_Alsa(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent = nullptr);
+    virtual ~AudioPlayer_Alsa();
+
+    bool isAvailable();
+    void play();
+    void stop();
+    void seek(double pos);
+
+    // taken by the next play()
+    void setDevice(const QString &device);
+    QString getDevice();
+    // in microseconds, the device picks the nearest
+    void setPeriodTime(int time);
+    int getPeriodTime();
+    void setBufferTime(int time);
+    int getBufferTime();
+
+protected slots:
+    void onDecoderSeekingStateChanged(bool isSeeking);
+
+protected:
+    Q_INVOKABLE void outputAudioData(int taskid);
+    // after an xrun or a suspend, false if the device is gone
+    bool recover(snd_pcm_t *pcm, int err);
+
+protected:
+    QThread m_thread;
+    int m_taskid;
+    QMutex m_mtx;
+    QString m_device;
+    QAtomicInt m_periodTime, m_bufferTime;
+};
+
+#endif // AUDIOPLAYER_ALSA_H
@@ -63,9 +63,7 @@ void AudioPlayer_DirectSound::seek(double pos)
     if (!m_decoderBuffer.seek(pos)) {
         return;
     }
-    m_ad.data.clear();
-    m_ad.time = 0.0;
-    m_ad.duration = 0.0;
+    resetClock(pos);
     setSeekingState(true);
 //    qDebug() << __PRETTY_FUNCTION__ << "end";
 }
@@ -109,7 +107,7 @@ void AudioPlayer_DirectSound::outputAudioData(int taskid)
     double notifyEverytime = 0.01;
     int bufferNotifySize = bytesPerSecond * notifyEverytime;
     qDebug() << __PRETTY_FUNCTION__ << "buffer notify size:" << bufferNotifySize;
-    m_decoderBuffer.setBufferMinSize(bufferNotifySize * 4);
+    m_decoderBuffer.setBufferMinDuration(notifyEverytime * 4);
 
     IDirectSound8 *pDS8 = 0;
     IDirectSoundBuffer *pDSBuffer = 0;
@@ -191,8 +189,7 @@ void AudioPlayer_DirectSound::outputAudioData(int taskid)
     setPlaybackState(true);
 
     while (taskid == m_taskid) {
-        if (m_ad.data.isEmpty()
-                && !m_decoderBuffer.hasBufferedData()
+        if (!m_decoderBuffer.hasBufferedData()
                 && m_decoderBuffer.isDecodeEnd()) {
             pDSBuffer8->Stop();
             setPlaybackState(false);
@@ -205,57 +202,50 @@ void AudioPlayer_DirectSound::outputAudioData(int taskid)
 //            continue;
 //        }
 
-        QByteArray data(bufferNotifySize, 0);
-        double pos = m_position;
-        int r = 0;
-        while (r < bufferNotifySize) {
-            if (!m_ad.data.isEmpty()) {
-                int cp = qMin(m_ad.data.size(), bufferNotifySize - r);
-                data.replace(r, cp, m_ad.data);
-                r += cp;
-                double dur = m_ad.duration * cp / m_ad.data.size();
-                m_ad.data.remove(0, cp);
-                m_ad.time += dur;
-                m_ad.duration -= dur ;
-                pos = m_ad.time;
-                continue;
-            }
+        VOID *buf1 = 0, *buf2 = 0;
+        DWORD buflen1, buflen2;
+        pDSBuffer8->Lock(offset, bufferNotifySize, &buf1, &buflen1, &buf2, &buflen2, 0);
 
-            if (!m_decoderBuffer.hasBufferedData()) {
-//                qDebug() << __PRETTY_FUNCTION__ << "decoder has no audio data";
-                break;
+        // copy straight from the decoder's ring buffer, silence for what it cannot give
+        double pos = m_position;
+        int r1 = 0, r2 = 0;
+        if (!m_isSeeking) {
+            double time = 0.0, time2 = 0.0;
+            r1 = m_decoderBuffer.readBufferedData((char*)buf1, buflen1, time);
+            if (r1 == (int)buflen1 && buf2) {
+                r2 = m_decoderBuffer.readBufferedData((char*)buf2, buflen2, time2);
             }
-            if (!m_isSeeking) {
-//                qDebug() <<  __PRETTY_FUNCTION__ << "popBufferedData";
-                m_ad = m_decoderBuffer.popBufferedData();
-            }
-            else {
-//                qDebug() <<  __PRETTY_FUNCTION__ << "is seeking, cannot popBufferedData";
-                break;
+            if (r1 > 0) {
+                pos = time + (double)(r1 + r2) / bytesPerSecond;
             }
         }
-
-        VOID *buf1 = 0, *buf2 = 0;
-        DWORD buflen1, buflen2;
-        pDSBuffer8->Lock(offset, bufferNotifySize, &buf1, &buflen1, &buf2, &buflen2, 0);
-        memcpy(buf1, data.data(), buflen1);
+        memset((char*)buf1 + r1, 0, buflen1 - r1);
         if (buf2) {
-            memcpy(buf2, data.data() + buflen1, buflen2);
+            memset((char*)buf2 + r2, 0, buflen2 - r2);
         }
+
         offset += buflen1 + buflen2;
         offset %= (bufferNotifySize * audioBufCount);
         pDSBuffer8->Unlock(buf1, buflen1, buf2, buflen2);
+
+        // what is between the play cursor and our write offset is still to be heard
+        if (r1 > 0) {
+            DWORD playCursor = 0, writeCursor = 0;
+            if (pDSBuffer8->GetCurrentPosition(&playCursor, &writeCursor) == DS_OK) {
+                int bufferSize = bufferNotifySize * audioBufCount;
+                int queued = (offset - (int)playCursor + bufferSize) % bufferSize;
+                // the silence padding the chunk is after pos, not before it
+                queued -= (buflen1 - r1) + (buf2 ? buflen2 - r2 : 0);
+                queued = qMax(queued, 0);
+                updateClock(pos, (double)queued / bytesPerSecond);
+            }
+        }
+
         WaitForMultipleObjects(audioBufCount, event, FALSE, notifyEverytime * 1000 * 2);
-        setPosition(pos);
+        setPosition(getClock());
     }
 
 END:
-    m_dataMtx.lock();
-    m_ad.data.clear();
-    m_ad.time = 0;
-    m_ad.duration = 0;
-    m_dataMtx.unlock();
-
     if (pDSNotify) {
         pDSNotify->Release();
     }
@@ -31,9 +31,8 @@ protected:
 protected:
     QThread m_thread;
     int m_taskid;
-    QMutex m_mtx, m_dataMtx;
+    QMutex m_mtx;
     QWaitCondition m_cond;
-    AudioDecoderBuffer::AudioData m_ad;
 };
 
 #endif // AUDIOPLAYER_DIRECTSOUND_H
@@ -0,0 +1,210 @@
+#include "audioplayer_null.h"
+#include "avclock.h"
+#include "smartmutex.h"
+
+// samples taken per round, in seconds
+#define CHUNK_DURATION          0.01
+// how far a real time sink runs ahead of the wall clock, like a device ring
+#define REALTIME_AHEAD          0.02
+
+AudioPlayer_Null::AudioPlayer_Null(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent)
+    : AudioPlayerBase(decoder, audioStreamIndex, parent)
+    , m_taskid(0)
+    , m_isRealtime(1)
+{
+    moveToThread(&m_thread);
+
+    if (isAvailable()) {
+        m_thread.start();
+
+        connect(&m_decoderBuffer, SIGNAL(seekingStateChanged(bool)),
+                this, SLOT(onDecoderSeekingStateChanged(bool)), Qt::DirectConnection);
+    }
+}
+
+AudioPlayer_Null::~AudioPlayer_Null()
+{
+    quitThread();
+}
+
+bool AudioPlayer_Null::isAvailable()
+{
+    return isDecoderAvailable();
+}
+
+void AudioPlayer_Null::play()
+{
+    if (isPlaying()) {
+        return;
+    }
+    if (!isAvailable()) {
+        return;
+    }
+
+    if (m_decoderBuffer.isDecodeEnd()) {
+        m_decoderBuffer.resetDecoder();
+    }
+    QMetaObject::invokeMethod(this, "outputAudioData", Q_ARG(int,++m_taskid));
+}
+
+void AudioPlayer_Null::stop()
+{
+    ++m_taskid;
+}
+
+void AudioPlayer_Null::seek(double pos)
+{
+    if (pos < 0.0) {
+        return;
+    }
+    if (!isAvailable()) {
+        return;
+    }
+    SmartMutex mtx(&m_mtx);
+    if (!m_decoderBuffer.seek(pos)) {
+        return;
+    }
+    resetClock(pos);
+    setSeekingState(true);
+}
+
+void AudioPlayer_Null::setRealtime(bool isRealtime)
+{
+    m_isRealtime.store(isRealtime ? 1 : 0);
+}
+
+bool AudioPlayer_Null::isRealtime()
+{
+    return m_isRealtime.load() != 0;
+}
+
+void AudioPlayer_Null::onDecoderSeekingStateChanged(bool isSeeking)
+{
+    m_mtx.lock();
+    setSeekingState(isSeeking);
+    m_mtx.unlock();
+}
+
+void AudioPlayer_Null::outputAudioData(int taskid)
+{
+    qDebug() << __PRETTY_FUNCTION__ << "start";
+
+    if (!isAvailable()) {
+        return;
+    }
+
+    int sampleRate = m_avdecoder->getAudioOutputSampleRate(m_enabledAudioStreamIndex);
+    int sampleSize = m_avdecoder->getAudioOutputSampleSize(m_enabledAudioStreamIndex);
+    int channels = m_avdecoder->getAudioOutputChannels(m_enabledAudioStreamIndex);
+    int bytesPerFrame = m_avdecoder->getAudioOutputBytesPerFrame(m_enabledAudioStreamIndex);
+    int bytesPerSecond = m_avdecoder->getAudioOutputBytesPerSecond(m_enabledAudioStreamIndex);
+    bool isRealtime = this->isRealtime();
+
+    int chunkSize = (int)(bytesPerSecond * CHUNK_DURATION) / bytesPerFrame * bytesPerFrame;
+    QByteArray chunk(chunkSize, 0);
+    m_decoderBuffer.setBufferMinDuration(CHUNK_DURATION * 4);
+
+    if (!openSink(sampleRate, channels, sampleSize)) {
+        setPlaybackState(false);
+        setSeekingState(false);
+        return;
+    }
+    setPlaybackState(true);
+
+    // what went through, for the log
+    qint64 start = AVClock::getSystemTime();
+    qint64 consumed = 0;
+    int starved = 0;
+    // samples handed on since the start, in microseconds, silence included
+    qint64 played = 0;
+
+    while (taskid == m_taskid) {
+        if (!m_decoderBuffer.hasBufferedData()
+                && m_decoderBuffer.isDecodeEnd()) {
+            setPlaybackState(false);
+            break;
+        }
+
+        if (isRealtime) {
+            // the deadline of this chunk, so waits do not add up
+            qint64 wait = start + played - (qint64)(REALTIME_AHEAD * 1000000) - AVClock::getSystemTime();
+            if (wait > 0) {
+                QThread::usleep(wait);
+            }
+        }
+
+        bool hasData = false;
+        {
+            SmartMutex mtx(&m_mtx);
+
+            double time = 0.0;
+            int r = 0;
+            if (!m_isSeeking) {
+                r = m_decoderBuffer.readBufferedData(chunk.data(), chunkSize, time);
+            }
+            if (r > 0) {
+                hasData = true;
+                writeSink(chunk.constData(), r);
+                consumed += r;
+                played += (qint64)r * 1000000 / bytesPerSecond;
+
+                double pos = time + (double)r / bytesPerSecond;
+                double delay = 0.0;
+                if (isRealtime) {
+                    delay = qMax(0.0, (start + played - AVClock::getSystemTime()) / 1000000.0);
+                }
+                updateClock(pos, delay);
+            }
+            else {
+                ++starved;
+                if (isRealtime) {
+                    // a device plays silence meanwhile
+                    played += (qint64)(CHUNK_DURATION * 1000000);
+                }
+            }
+            setPosition(getClock());
+        }
+
+        if (!hasData && !isRealtime) {
+            // waiting for the decoder
+            QThread::usleep(CHUNK_DURATION * 1000000 / 10);
+        }
+    }
+
+    closeSink();
+
+    double elapsed = (AVClock::getSystemTime() - start) / 1000000.0;
+    double duration = (double)consumed / bytesPerSecond;
+    qDebug() << __PRETTY_FUNCTION__ << (isRealtime ? "real time" : "unthrottled")
+             << "consumed:" << duration << "s in:" << elapsed << "s"
+             << "speed:" << (elapsed > 0.0 ? duration / elapsed : 0.0)
+             << "starved rounds:" << starved;
+
+    setPlaybackState(false);
+    setSeekingState(false);
+
+    qDebug() << __PRETTY_FUNCTION__ << "end";
+}
+
+bool AudioPlayer_Null::openSink(int, int, int)
+{
+    return true;
+}
+
+void AudioPlayer_Null::writeSink(const char *, int)
+{
+}
+
+void AudioPlayer_Null::closeSink()
+{
+}
+
+void AudioPlayer_Null::quitThread()
+{
+    stop();
+
+    if (m_thread.isRunning()) {
+        m_thread.quit();
+        m_thread.wait();
+    }
+}
@@ -0,0 +1,50 @@
+#ifndef AUDIOPLAYER_NULL_H
+#define AUDIOPLAYER_NULL_H
+
+#include <QtCore>
+
+#include "audioplayerbase.h"
+#include "audiodecoderbuffer.h"
+
+// Consumes the decoded samples without a sound card, in real time like a
+// device would, or as fast as they are decoded. Logs what it got through and
+// how often the decoder kept it waiting when it stops, to measure the audio
+// path alone. Subclasses get the samples through the sink hooks.
+class AudioPlayer_Null : public AudioPlayerBase
+{
+    Q_OBJECT
+public:
+    explicit AudioPlayer_Null(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent = nullptr);
+    virtual ~AudioPlayer_Null();
+
+    bool isAvailable();
+    void play();
+    void stop();
+    void seek(double pos);
+
+    // taken by the next play()
+    void setRealtime(bool isRealtime);
+    bool isRealtime();
+
+protected slots:
+    void onDecoderSeekingStateChanged(bool isSeeking);
+
+protected:
+    Q_INVOKABLE void outputAudioData(int taskid);
+
+    // on the output thread, around every run of outputAudioData()
+    virtual bool openSink(int sampleRate, int channels, int sampleSize);
+    virtual void writeSink(const char *data, int size);
+    virtual void closeSink();
+
+    // for the destructors of the subclasses, before their sink goes
+    void quitThread();
+
+protected:
+    QThread m_thread;
+    int m_taskid;
+    QMutex m_mtx;
+    QAtomicInt m_isRealtime;
+};
+
+#endif // AUDIOPLAYER_NULL_H
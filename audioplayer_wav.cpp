@@ -0,0 +1,98 @@
+#include "audioplayer_wav.h"
+
+// RIFF, fmt and data chunk headers of a PCM WAV file
+#define WAV_HEADER_SIZE         44
+
+AudioPlayer_Wav::AudioPlayer_Wav(AVDecoderCore *decoder, int audioStreamIndex, const QString &file, QObject *parent)
+    : AudioPlayer_Null(decoder, audioStreamIndex, parent)
+    , m_file(file)
+    , m_sampleRate(0)
+    , m_channels(0)
+    , m_sampleSize(0)
+    , m_dataSize(0)
+{
+    setRealtime(false);
+}
+
+AudioPlayer_Wav::~AudioPlayer_Wav()
+{
+    // the output thread may still be writing
+    quitThread();
+
+    if (m_file.isOpen()) {
+        m_file.close();
+    }
+}
+
+QString AudioPlayer_Wav::getFile()
+{
+    return m_file.fileName();
+}
+
+bool AudioPlayer_Wav::openSink(int sampleRate, int channels, int sampleSize)
+{
+    if (m_file.isOpen()) {
+        if (sampleRate != m_sampleRate || channels != m_channels || sampleSize != m_sampleSize) {
+            qDebug() << __PRETTY_FUNCTION__ << "format changed, cannot append to" << m_file.fileName();
+            return false;
+        }
+        return true;
+    }
+
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qDebug() << __PRETTY_FUNCTION__ << "cannot open" << m_file.fileName() << m_file.errorString();
+        return false;
+    }
+    m_sampleRate = sampleRate;
+    m_channels = channels;
+    m_sampleSize = sampleSize;
+    m_dataSize = 0;
+    writeHeader();
+    return true;
+}
+
+void AudioPlayer_Wav::writeSink(const char *data, int size)
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    qint64 written = m_file.write(data, size);
+    if (written > 0) {
+        m_dataSize += written;
+    }
+}
+
+void AudioPlayer_Wav::closeSink()
+{
+    if (!m_file.isOpen()) {
+        return;
+    }
+    // valid after every stop, the file stays open for the next play()
+    writeHeader();
+    m_file.flush();
+}
+
+void AudioPlayer_Wav::writeHeader()
+{
+    int blockAlign = m_channels * m_sampleSize / 8;
+
+    QDataStream stream(&m_file);
+    stream.setByteOrder(QDataStream::LittleEndian);
+
+    qint64 pos = m_file.pos();
+    m_file.seek(0);
+    stream.writeRawData("RIFF", 4);
+    stream << (quint32)(WAV_HEADER_SIZE - 8 + m_dataSize);
+    stream.writeRawData("WAVE", 4);
+    stream.writeRawData("fmt ", 4);
+    stream << (quint32)16;
+    stream << (quint16)1;                           // PCM
+    stream << (quint16)m_channels;
+    stream << (quint32)m_sampleRate;
+    stream << (quint32)(m_sampleRate * blockAlign); // bytes per second
+    stream << (quint16)blockAlign;
+    stream << (quint16)m_sampleSize;
+    stream.writeRawData("data", 4);
+    stream << (quint32)m_dataSize;
+    m_file.seek(qMax(pos, (qint64)WAV_HEADER_SIZE));
+}
@@ -0,0 +1,33 @@
+#ifndef AUDIOPLAYER_WAV_H
+#define AUDIOPLAYER_WAV_H
+
+#include <QtCore>
+
+#include "audioplayer_null.h"
+
+// Writes the decoded samples into a WAV file, unthrottled unless told
+// otherwise. The file is truncated by the first play(), later ones append.
+class AudioPlayer_Wav : public AudioPlayer_Null
+{
+    Q_OBJECT
+public:
+    explicit AudioPlayer_Wav(AVDecoderCore *decoder, int audioStreamIndex, const QString &file, QObject *parent = nullptr);
+    virtual ~AudioPlayer_Wav();
+
+    QString getFile();
+
+protected:
+    bool openSink(int sampleRate, int channels, int sampleSize);
+    void writeSink(const char *data, int size);
+    void closeSink();
+
+    // with the sizes of what is written so far
+    void writeHeader();
+
+protected:
+    QFile m_file;
+    int m_sampleRate, m_channels, m_sampleSize;
+    quint32 m_dataSize;
+};
+
+#endif // AUDIOPLAYER_WAV_H
@@ -1,4 +1,11 @@
 #include "audioplayerbase.h"
+#include "avclock.h"
+#include "smartmutex.h"
+
+// the device positions come in steps, differences up to this are eased in
+#define CLOCK_MAX_SLEW          0.02
+// part of such a difference taken per update
+#define CLOCK_SLEW_FACTOR       0.125
 
 AudioPlayerBase::AudioPlayerBase(AVDecoderCore *decoder, int audioStreamIndex, QObject *parent)
     : QObject(parent)
@@ -8,6 +15,10 @@ AudioPlayerBase::AudioPlayerBase(AVDecoderCore *decoder, int audioStreamIndex, Q
     , m_isPlaying(false)
     , m_position(0.0)
     , m_isSeeking(false)
+    , m_clockPts(0.0)
+    , m_clockTime(0)
+    , m_clockLimit(0.0)
+    , m_isClockRunning(false)
 {
 }
 
@@ -34,6 +45,16 @@ bool AudioPlayerBase::isSeeking()
     return m_isSeeking;
 }
 
+double AudioPlayerBase::getClock()
+{
+    SmartMutex mtx(&m_clockMtx);
+    if (!m_isClockRunning) {
+        return m_clockPts;
+    }
+    double pts = m_clockPts + (AVClock::getSystemTime() - m_clockTime) / 1000000.0;
+    return qMin(pts, m_clockLimit);
+}
+
 bool AudioPlayerBase::isDecoderAvailable()
 {
     if (m_avdecoder == 0) {
@@ -57,6 +78,13 @@ void AudioPlayerBase::setPlaybackState(bool isPlaying)
         return;
     }
     m_isPlaying = isPlaying;
+    if (!isPlaying) {
+        // what the device still had queued is gone
+        double pts = getClock();
+        SmartMutex mtx(&m_clockMtx);
+        m_clockPts = pts;
+        m_isClockRunning = false;
+    }
     emit playbackStateChanged(isPlaying);
 }
 
@@ -79,3 +107,32 @@ void AudioPlayerBase::setSeekingState(bool isSeeking)
 //    qDebug() << __PRETTY_FUNCTION__ << "isSeeking:" << isSeeking;
     emit seekingStateChanged(isSeeking);
 }
+
+void AudioPlayerBase::updateClock(double pts, double delay)
+{
+    qint64 time = AVClock::getSystemTime();
+    double heard = pts - delay;
+
+    SmartMutex mtx(&m_clockMtx);
+    if (m_isClockRunning) {
+        double predicted = qMin(m_clockPts + (time - m_clockTime) / 1000000.0, m_clockLimit);
+        double diff = heard - predicted;
+        if (qAbs(diff) < CLOCK_MAX_SLEW) {
+            // the clock stays continuous, a real jump is taken at once
+            heard = predicted + diff * CLOCK_SLEW_FACTOR;
+        }
+    }
+    m_clockPts = heard;
+    m_clockTime = time;
+    m_clockLimit = pts;
+    m_isClockRunning = true;
+}
+
+void AudioPlayerBase::resetClock(double pts)
+{
+    SmartMutex mtx(&m_clockMtx);
+    m_clockPts = pts;
+    m_clockTime = AVClock::getSystemTime();
+    m_clockLimit = pts;
+    m_isClockRunning = false;
+}
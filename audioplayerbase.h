@@ -22,6 +22,11 @@ public:
     double getPosition();
     bool isSeeking();
 
+    // pts of what is heard now, the device latency taken off and run on the
+    // system time between the updates of the output thread; for the video to
+    // read any time, from any thread
+    double getClock();
+
 signals:
     void playbackStateChanged(bool isPlaying);
     void positionChanged(double postion);
@@ -33,6 +38,12 @@ protected:
     void setPosition(double pos);
     void setSeekingState(bool isSeeking);
 
+    // by the output thread after writing to the device, pts is the end of
+    // what was written and delay the part of it not played yet, in seconds
+    void updateClock(double pts, double delay);
+    // nothing queued from here on, e.g. after a seek
+    void resetClock(double pts);
+
 protected:
     AVDecoderCore * m_avdecoder;
     int m_enabledAudioStreamIndex;
@@ -40,6 +51,13 @@ protected:
     bool m_isPlaying;
     double m_position;
     bool m_isSeeking;
+
+    QMutex m_clockMtx;
+    double m_clockPts;
+    qint64 m_clockTime;
+    // end of what was written, the device cannot play past it
+    double m_clockLimit;
+    bool m_isClockRunning;
 };
 
 #endif // AUDIOPLAYERBASE_H
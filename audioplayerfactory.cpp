@@ -0,0 +1,164 @@
+#include "audioplayerfactory.h"
+#include "audioplayer_null.h"
+#include "audioplayer_wav.h"
+#include "smartmutex.h"
+#ifdef Q_OS_WIN
+#include "audioplayer_directsound.h"
+#else
+#include "audioplayer_alsa.h"
+#endif
+
+// environment variable with the spec of the default sink
+#define AUDIO_SINK_ENV          "FFMPEGPLAYER_AUDIO_SINK"
+
+#ifdef Q_OS_WIN
+#define PLATFORM_SINK           "directsound"
+
+static AudioPlayerBase *createDirectSound(AVDecoderCore *decoder, int audioStreamIndex, const QString &)
+{
+    return new AudioPlayer_DirectSound(decoder, audioStreamIndex);
+}
+#else
+#define PLATFORM_SINK           "alsa"
+
+// "device=hw:0,0,period=5000,buffer=20000", times in microseconds; a part
+// without "=" belongs to the value before, as the commas of "hw:0,0"
+static AudioPlayerBase *createAlsa(AVDecoderCore *decoder, int audioStreamIndex, const QString &options)
+{
+    AudioPlayer_Alsa *player = new AudioPlayer_Alsa(decoder, audioStreamIndex);
+
+    QList<QPair<QString, QString> > values;
+    QStringList parts = options.split(',', QString::SkipEmptyParts);
+    for (int i = 0; i < parts.count(); ++i) {
+        int j = parts[i].indexOf('=');
+        if (j < 0) {
+            if (!values.isEmpty()) {
+                values.last().second += "," + parts[i];
+            }
+            continue;
+        }
+        values.append(qMakePair(parts[i].left(j).trimmed(), parts[i].mid(j + 1)));
+    }
+
+    for (int i = 0; i < values.count(); ++i) {
+        const QString &key = values[i].first;
+        const QString &value = values[i].second;
+        if (key == "device") {
+            player->setDevice(value);
+        }
+        else if (key == "period") {
+            player->setPeriodTime(value.toInt());
+        }
+        else if (key == "buffer") {
+            player->setBufferTime(value.toInt());
+        }
+        else {
+            qDebug() << __PRETTY_FUNCTION__ << "unknown alsa option:" << key;
+        }
+    }
+    return player;
+}
+#endif
+
+static AudioPlayerBase *createNull(AVDecoderCore *decoder, int audioStreamIndex, const QString &options)
+{
+    AudioPlayer_Null *player = new AudioPlayer_Null(decoder, audioStreamIndex);
+    player->setRealtime(options != "unthrottled");
+    return player;
+}
+
+static AudioPlayerBase *createWav(AVDecoderCore *decoder, int audioStreamIndex, const QString &options)
+{
+    if (options.isEmpty()) {
+        qDebug() << __PRETTY_FUNCTION__ << "no file, use wav:<file>";
+        return 0;
+    }
+    return new AudioPlayer_Wav(decoder, audioStreamIndex, options);
+}
+
+namespace {
+struct Registry {
+    QMutex mtx;
+    QMap<QString, AudioPlayerCreator> creators;
+
+    Registry()
+    {
+#ifdef Q_OS_WIN
+        creators.insert("directsound", createDirectSound);
+#else
+        creators.insert("alsa", createAlsa);
+#endif
+        creators.insert("null", createNull);
+        creators.insert("wav", createWav);
+    }
+};
+}
+
+static Registry &registry()
+{
+    static Registry s_registry;
+    return s_registry;
+}
+
+void AudioPlayerFactory::registerPlayer(const QString &name, AudioPlayerCreator creator)
+{
+    if (name.isEmpty() || name.contains(':') || creator == 0) {
+        return;
+    }
+    SmartMutex mtx(&registry().mtx);
+    registry().creators.insert(name, creator);
+}
+
+QStringList AudioPlayerFactory::getPlayerNames()
+{
+    SmartMutex mtx(&registry().mtx);
+    return registry().creators.keys();
+}
+
+bool AudioPlayerFactory::hasPlayer(const QString &spec)
+{
+    QString name, options;
+    parseSpec(spec, name, options);
+    SmartMutex mtx(&registry().mtx);
+    return registry().creators.contains(name);
+}
+
+QString AudioPlayerFactory::getDefaultSpec()
+{
+    QString spec = QString::fromLocal8Bit(qgetenv(AUDIO_SINK_ENV));
+    if (!spec.isEmpty()) {
+        return spec;
+    }
+    return PLATFORM_SINK;
+}
+
+AudioPlayerBase *AudioPlayerFactory::create(const QString &spec, AVDecoderCore *decoder, int audioStreamIndex)
+{
+    QString name, options;
+    parseSpec(spec, name, options);
+
+    AudioPlayerCreator creator = 0;
+    {
+        SmartMutex mtx(&registry().mtx);
+        creator = registry().creators.value(name, 0);
+    }
+    if (creator == 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "unknown audio sink:" << spec
+                 << "known:" << getPlayerNames();
+        return 0;
+    }
+    qDebug() << __PRETTY_FUNCTION__ << "audio sink:" << spec;
+    return creator(decoder, audioStreamIndex, options);
+}
+
+void AudioPlayerFactory::parseSpec(const QString &spec, QString &name, QString &options)
+{
+    int i = spec.indexOf(':');
+    if (i < 0) {
+        name = spec.trimmed();
+        options.clear();
+        return;
+    }
+    name = spec.left(i).trimmed();
+    options = spec.mid(i + 1);
+}
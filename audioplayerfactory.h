@@ -0,0 +1,37 @@
+#ifndef AUDIOPLAYERFACTORY_H
+#define AUDIOPLAYERFACTORY_H
+
+#include <QtCore>
+
+#include "audioplayerbase.h"
+
+// options is what follows the name in a sink spec, "wav:/tmp/out.wav" gives "/tmp/out.wav"
+typedef AudioPlayerBase *(*AudioPlayerCreator)(AVDecoderCore *decoder, int audioStreamIndex, const QString &options);
+
+// Audio sinks by name, picked at runtime with a spec of "name" or
+// "name:options". Built in are the output of the platform ("directsound" or
+// "alsa"), "null" which consumes the samples in real time, or as fast as
+// they are decoded with "null:unthrottled", and "wav:<file>" writing them
+// into a WAV file. Other outputs register themselves with registerPlayer().
+//
+// The alsa sink takes the device and its period and buffer times in
+// microseconds, e.g. "alsa:device=hw:0,0,period=5000,buffer=20000".
+class AudioPlayerFactory
+{
+public:
+    static void registerPlayer(const QString &name, AudioPlayerCreator creator);
+    static QStringList getPlayerNames();
+    static bool hasPlayer(const QString &spec);
+
+    // FFMPEGPLAYER_AUDIO_SINK if set, e.g. "null" on machines without a
+    // sound card, the output of the platform otherwise
+    static QString getDefaultSpec();
+
+    // 0 if there is no sink of that name
+    static AudioPlayerBase *create(const QString &spec, AVDecoderCore *decoder, int audioStreamIndex);
+
+protected:
+    static void parseSpec(const QString &spec, QString &name, QString &options);
+};
+
+#endif // AUDIOPLAYERFACTORY_H
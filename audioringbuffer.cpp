@@ -0,0 +1,173 @@
+#include "audioringbuffer.h"
+
+// one mark per decoded frame is pushed, far more than a second of audio needs
+#define MAX_TIME_MARKS  1024
+
+AudioRingBuffer::AudioRingBuffer()
+    : m_data(0)
+    , m_capacity(0)
+    , m_bytesPerFrame(1)
+    , m_bytesPerSecond(0)
+    , m_readPos(0)
+    , m_writePos(0)
+    , m_clearPos(0)
+    , m_clearSerial(0)
+    , m_timeMarks(MAX_TIME_MARKS)
+    , m_readClearSerial(0)
+    , m_hasTimeMark(false)
+{
+}
+
+AudioRingBuffer::~AudioRingBuffer()
+{
+    release();
+}
+
+bool AudioRingBuffer::allocate(int capacity, int bytesPerFrame, int bytesPerSecond)
+{
+    if (capacity <= 0 || bytesPerFrame <= 0 || bytesPerSecond <= 0) {
+        return false;
+    }
+
+    release();
+    m_capacity = capacity / bytesPerFrame * bytesPerFrame;
+    m_data = new char[m_capacity];
+    m_bytesPerFrame = bytesPerFrame;
+    m_bytesPerSecond = bytesPerSecond;
+    return true;
+}
+
+void AudioRingBuffer::release()
+{
+    delete[] m_data;
+    m_data = 0;
+    m_capacity = 0;
+    m_readPos.store(0);
+    m_writePos.store(0);
+    m_clearPos.store(0);
+    m_timeMarks.clear();
+    m_hasTimeMark = false;
+}
+
+int AudioRingBuffer::getCapacity()
+{
+    return m_capacity;
+}
+
+int AudioRingBuffer::getBytesPerFrame()
+{
+    return m_bytesPerFrame;
+}
+
+int AudioRingBuffer::getBytesPerSecond()
+{
+    return m_bytesPerSecond;
+}
+
+int AudioRingBuffer::getReadableSize()
+{
+    qint64 writePos = m_writePos.loadAcquire();
+    qint64 readPos = qMax(m_readPos.loadAcquire(), m_clearPos.loadAcquire());
+    return qMax((qint64)0, writePos - readPos);
+}
+
+int AudioRingBuffer::getWritableSize()
+{
+    // cleared bytes stay taken until the reader has skipped them
+    return m_capacity - (int)(m_writePos.load() - m_readPos.loadAcquire());
+}
+
+double AudioRingBuffer::getReadableDuration()
+{
+    if (m_bytesPerSecond <= 0) {
+        return 0.0;
+    }
+    return (double)getReadableSize() / m_bytesPerSecond;
+}
+
+char *AudioRingBuffer::getWriteSpan(int &size)
+{
+    if (m_data == 0) {
+        size = 0;
+        return 0;
+    }
+    qint64 writePos = m_writePos.load();
+    int index = writePos % m_capacity;
+    size = qMin(m_capacity - (int)(writePos - m_readPos.loadAcquire()), m_capacity - index);
+    return m_data + index;
+}
+
+void AudioRingBuffer::commitWrite(int size)
+{
+    qint64 writePos = m_writePos.load();
+    size = qMin(size, m_capacity - (int)(writePos - m_readPos.loadAcquire()));
+    if (size > 0) {
+        m_writePos.storeRelease(writePos + size);
+    }
+}
+
+void AudioRingBuffer::addTimeMark(int offset, double time)
+{
+    // without room the time is extrapolated from the previous mark
+    m_timeMarks.push(TimeMark(m_writePos.load() + offset, time));
+}
+
+void AudioRingBuffer::clear()
+{
+    m_clearPos.storeRelease(m_writePos.load());
+    m_timeMarks.clear();
+    m_clearSerial.fetchAndAddOrdered(1);
+}
+
+int AudioRingBuffer::read(char *data, int maxSize, double &time)
+{
+    if (m_data == 0) {
+        return 0;
+    }
+
+    qint64 readPos = m_readPos.load();
+    int clearSerial = m_clearSerial.loadAcquire();
+    if (clearSerial != m_readClearSerial) {
+        m_readClearSerial = clearSerial;
+        qint64 clearPos = m_clearPos.loadAcquire();
+        if (readPos < clearPos) {
+            readPos = clearPos;
+            m_readPos.storeRelease(readPos);
+        }
+        m_hasTimeMark = false;
+    }
+
+    int size = qMin((qint64)maxSize, m_writePos.loadAcquire() - readPos);
+    size = size / m_bytesPerFrame * m_bytesPerFrame;
+    if (size <= 0) {
+        return 0;
+    }
+
+    time = getTimeAt(readPos);
+
+    int index = readPos % m_capacity;
+    int size1 = qMin(size, m_capacity - index);
+    memcpy(data, m_data + index, size1);
+    if (size1 < size) {
+        memcpy(data + size1, m_data, size - size1);
+    }
+    m_readPos.storeRelease(readPos + size);
+    return size;
+}
+
+double AudioRingBuffer::getTimeAt(qint64 pos)
+{
+    TimeMark mark;
+    while (m_timeMarks.front(mark) && mark.pos <= pos) {
+        m_timeMarks.pop(m_timeMark);
+        m_hasTimeMark = true;
+    }
+
+    if (m_hasTimeMark) {
+        return m_timeMark.time + (double)(pos - m_timeMark.pos) / m_bytesPerSecond;
+    }
+    if (m_timeMarks.front(mark)) {
+        return mark.time - (double)(mark.pos - pos) / m_bytesPerSecond;
+    }
+    return 0.0;
+}
@@ -0,0 +1,76 @@
+#ifndef AUDIORINGBUFFER_H
+#define AUDIORINGBUFFER_H
+
+#include <QtCore>
+
+#include "spscqueue.h"
+
+// Fixed capacity PCM buffer between the audio decoder and an output backend.
+// The decoder converts samples straight into getWriteSpan(), the backend
+// copies them out with read(). Timestamps are kept as marks on the byte
+// stream, so the time of any byte read can be told.
+//
+// One thread writes and one thread reads, positions are atomics so neither
+// side takes a lock. allocate() and release() must not race with either.
+class AudioRingBuffer
+{
+public:
+    AudioRingBuffer();
+    ~AudioRingBuffer();
+
+    // the capacity is rounded down to whole frames
+    bool allocate(int capacity, int bytesPerFrame, int bytesPerSecond);
+    void release();
+
+    int getCapacity();
+    int getBytesPerFrame();
+    int getBytesPerSecond();
+    // fill level, read from the positions without locking
+    int getReadableSize();
+    int getWritableSize();
+    double getReadableDuration();
+
+    // producer side, the span is contiguous and may be shorter than
+    // getWritableSize() where the buffer wraps
+    char *getWriteSpan(int &size);
+    void commitWrite(int size);
+    // the data written offset bytes from now starts at time
+    void addTimeMark(int offset, double time);
+    // drop everything written so far, the reader skips it on its next read
+    void clear();
+
+    // consumer side, time is the timestamp of the first byte read
+    int read(char *data, int maxSize, double &time);
+
+protected:
+    struct TimeMark {
+        qint64 pos;
+        double time;
+
+        TimeMark() : pos(0), time(0.0) {}
+        TimeMark(qint64 _pos, double _time) : pos(_pos), time(_time) {}
+    };
+
+    double getTimeAt(qint64 pos);
+
+private:
+    char *m_data;
+    int m_capacity;
+    int m_bytesPerFrame;
+    int m_bytesPerSecond;
+
+    // total bytes ever read and written, the index is pos % capacity
+    QAtomicInteger<qint64> m_readPos;
+    QAtomicInteger<qint64> m_writePos;
+    QAtomicInteger<qint64> m_clearPos;
+    QAtomicInt m_clearSerial;
+
+    SpscQueue<TimeMark> m_timeMarks;
+
+    // reader only
+    int m_readClearSerial;
+    TimeMark m_timeMark;
+    bool m_hasTimeMark;
+};
+
+#endif // AUDIORINGBUFFER_H
@@ -0,0 +1,86 @@
+#include "avclock.h"
+
+namespace {
+struct SystemTimer {
+    QElapsedTimer timer;
+
+    SystemTimer() { timer.start(); }
+};
+}
+
+AVClock::AVClock()
+    : m_masterType(MASTER_AUDIO)
+    , m_pts(0.0)
+    , m_time(0)
+    , m_isPaused(true)
+{
+
+}
+
+qint64 AVClock::getSystemTime()
+{
+    // QElapsedTimer is monotonic on the platforms we run on
+    static SystemTimer s_systemTimer;
+    return s_systemTimer.timer.nsecsElapsed() / 1000;
+}
+
+void AVClock::setMasterType(AVClock::MASTER_Type type)
+{
+    m_masterType = type;
+}
+
+AVClock::MASTER_Type AVClock::getMasterType()
+{
+    return m_masterType;
+}
+
+void AVClock::set(double pts)
+{
+    set(pts, getSystemTime());
+}
+
+void AVClock::set(double pts, qint64 time)
+{
+    m_pts = pts;
+    m_time = time;
+}
+
+double AVClock::get()
+{
+    if (m_isPaused) {
+        return m_pts;
+    }
+    return m_pts + (getSystemTime() - m_time) / 1000000.0;
+}
+
+qint64 AVClock::getTimeOf(double pts)
+{
+    if (m_isPaused) {
+        return getSystemTime() + (qint64)((pts - m_pts) * 1000000.0);
+    }
+    return m_time + (qint64)((pts - m_pts) * 1000000.0);
+}
+
+void AVClock::pause()
+{
+    if (m_isPaused) {
+        return;
+    }
+    m_pts = get();
+    m_time = getSystemTime();
+    m_isPaused = true;
+}
+
+void AVClock::resume()
+{
+    if (!m_isPaused) {
+        return;
+    }
+    m_time = getSystemTime();
+    m_isPaused = false;
+}
+
+bool AVClock::isPaused()
+{
+    return m_isPaused;
+}
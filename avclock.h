@@ -0,0 +1,47 @@
+#ifndef AVCLOCK_H
+#define AVCLOCK_H
+
+#include <QtCore>
+
+// Presentation clock in seconds of the stream. Between two set() it runs on
+// the monotonic system time, the master decides who sets it: the audio output,
+// the video frames being shown, or nobody after the start (external).
+//
+// Not thread safe, it belongs to the thread scheduling the video.
+class AVClock
+{
+public:
+    enum MASTER_Type {
+        MASTER_AUDIO = 0,
+        MASTER_VIDEO,
+        MASTER_EXTERNAL,        // the system time
+    };
+
+public:
+    AVClock();
+
+    // monotonic, in microseconds
+    static qint64 getSystemTime();
+
+    void setMasterType(MASTER_Type type);
+    MASTER_Type getMasterType();
+
+    void set(double pts);
+    // pts was reached at the system time
+    void set(double pts, qint64 time);
+    double get();
+    // system time at which the clock reads pts, if it keeps running
+    qint64 getTimeOf(double pts);
+
+    void pause();
+    void resume();
+    bool isPaused();
+
+private:
+    MASTER_Type m_masterType;
+    double m_pts;
+    qint64 m_time;
+    bool m_isPaused;
+};
+
+#endif // AVCLOCK_H
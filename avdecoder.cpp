@@ -91,6 +91,8 @@ bool AVDecoder::load(const QString &file, DECODING_Type decodeType)
     unload();
 
     m_formatContext = avformat_alloc_context();
+    m_interrupter.install(m_formatContext);
+    m_interrupter.arm();
     int result = avformat_open_input(&m_formatContext, file.toStdString().c_str(),NULL,NULL);
     if (result < 0){
         qDebug() << "打开媒体流失败";
@@ -241,6 +243,7 @@ void AVDecoder::unload()
         return;
     }
 
+    m_interrupter.interrupt();
     SmartMutex mtx(&m_opeMtx);
 
     if (m_videoCodecContext) {
@@ -284,7 +287,7 @@ void AVDecoder::unload()
     m_videoDatas.clear();
     m_dataMtx.unlock();
 
-    clearRequestList();
+    m_commands.clear();
 }
 
 bool AVDecoder::isLoaded()
@@ -384,7 +387,7 @@ double AVDecoder::audio_getDuration()
 
 void AVDecoder::audio_seek(double time)
 {
-    removeDecodeRequests();
+    m_interrupter.interrupt();
     requestSeekAudio(time);
 }
 
@@ -494,7 +497,7 @@ void AVDecoder::video_seek(double pos, SEEK_Type type)
     if (!video_hasStream()) {
         return;
     }
-    removeDecodeRequests();
+    m_interrupter.interrupt();
     requestSeekVideo(pos, type);
 }
 
@@ -571,36 +574,26 @@ void AVDecoder::setSeekingState(bool isSeeking)
 void AVDecoder::handleRequests()
 {
     while (1) {
-        m_reqMtx.lock();
-        if (m_requestList.isEmpty()) {
-//            qDebug() << "cond in";
-            m_cond.wait(&m_reqMtx);
-//            qDebug() << "cond out";
-            m_reqMtx.unlock();
-            continue;
-        }
-        Request req = m_requestList.front();
-        m_requestList.pop_front();
-        m_reqMtx.unlock();
-//        qDebug() << "request:" << req.rid << req.p1;
-
-        switch (req.rid) {
-        case REQUEST_DECODE:
-            doDecode(req.p1);
-            break;
+        DecoderCommand cmd = m_commands.take();
+//        qDebug() << "command:" << cmd.type << cmd.pos;
+        m_interrupter.arm();
 
-        case REQUEST_AUDIO_SEEK:
-            doSeekAudio(req.p1.toDouble());
+        switch (cmd.type) {
+        case DecoderCommand::DECODE:
+            doDecode(cmd);
             break;
 
-        case REQUEST_VIDEO_SEEK:
-            doSeekVideo(req.p1.toMap()["pos"].toDouble(), (SEEK_Type)req.p1.toMap()["type"].toInt());
+        case DecoderCommand::SEEK:
+            if (cmd.stream == m_audioStreamIndex) {
+                doSeekAudio(cmd.pos);
+            }
+            else {
+                doSeekVideo(cmd.pos, (SEEK_Type)cmd.seekType, cmd.token);
+            }
             break;
 
-        case REQUEST_QUIT:
-            m_reqMtx.lock();
-            m_requestList.clear();
-            m_reqMtx.unlock();
+        case DecoderCommand::QUIT:
+            m_commands.clear();
             return;
 
         default:
@@ -609,69 +602,32 @@ void AVDecoder::handleRequests()
     }
 }
 
-void AVDecoder::pushRequest(const Request &req)
+void AVDecoder::requestDecode()
 {
-    m_reqMtx.lock();
-    m_requestList.push_back(req);
-    m_cond.wakeAll();
-    m_reqMtx.unlock();
-}
-
-void AVDecoder::clearRequestList()
-{
-    m_reqMtx.lock();
-    m_requestList.clear();
-    m_reqMtx.unlock();
-}
-
-void AVDecoder::removeDecodeRequests()
-{
-    m_reqMtx.lock();
-    for (QList<Request>::iterator it = m_requestList.begin(); it != m_requestList.end(); ) {
-        if (it->rid == REQUEST_DECODE) {
-            it = m_requestList.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
-    m_reqMtx.unlock();
-}
-
-void AVDecoder::requestDecode(QVariant p)
-{
-    Request req(REQUEST_DECODE, p);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::decode());
 }
 
 void AVDecoder::requestSeekAudio(double pos)
 {
-    Request req(REQUEST_AUDIO_SEEK, pos);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::seek(m_audioStreamIndex, pos));
 }
 
 void AVDecoder::requestSeekVideo(double pos, SEEK_Type type)
 {
-    QVariantMap vmap;
-    vmap["pos"] = pos;
-    vmap["type"] = type;
-    Request req(REQUEST_VIDEO_SEEK, vmap);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::seek(m_videoStreamIndex, pos, type));
 }
 
 void AVDecoder::requestQuit()
 {
-    Request req(REQUEST_QUIT);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::quit());
 }
 
-void AVDecoder::doDecode(QVariant p)
+void AVDecoder::doDecode(const DecoderCommand &cmd)
 {
     SmartMutex mtx(&m_opeMtx);
 
-    QVariantMap vmap = p.toMap();
-    bool needSeekPos = vmap.keys().contains("pos");
-    double pos = vmap["pos"].toDouble();
+    bool needSeekPos = cmd.hasPos;
+    double pos = cmd.pos;
 
     if (m_decodingState == DECODING_STOPPED) {
         return;
@@ -687,6 +643,9 @@ void AVDecoder::doDecode(QVariant p)
                 emit audioDataBuffered();
                 return;
             }
+            if (m_commands.isCanceled(cmd.token)) {
+                return;
+            }
 
             AVPacket *avPacket = new AVPacket;
             QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
@@ -812,6 +771,9 @@ void AVDecoder::doDecode(QVariant p)
                 emit videoDataBuffered();
                 return;
             }
+            if (m_commands.isCanceled(cmd.token)) {
+                return;
+            }
 
             AVPacket *avPacket = new AVPacket;
             QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
@@ -915,13 +877,10 @@ void AVDecoder::doSeekAudio(double pos)
     av_seek_frame(m_formatContext, m_audioStreamIndex, pos / av_q2d(m_audioStream->time_base), AVSEEK_FLAG_BACKWARD);
     qDebug() << "doAudioSeek cost" << t.elapsed() << "ms";
 
-    QVariantMap mp;
-    mp["needSeekPos"] = true;
-    mp["pos"] = pos;
-    requestDecode(mp);
+    m_commands.push(DecoderCommand::decode(pos));
 }
 
-void AVDecoder::doSeekVideo(double pos, SEEK_Type type)
+void AVDecoder::doSeekVideo(double pos, SEEK_Type type, int token)
 {
     if (pos < 0) {
         return;
@@ -940,12 +899,12 @@ void AVDecoder::doSeekVideo(double pos, SEEK_Type type)
     QTime t;
     t.start();
 
-    QVariantMap vmap;
+    DecoderCommand decodeCmd = DecoderCommand::decode();
     m_opeMtx.lock();
     avcodec_flush_buffers(m_videoCodecContext);
     if (type == SEEK_POS) {
         av_seek_frame(m_formatContext, m_videoStreamIndex, pos / av_q2d(m_videoStream->time_base), AVSEEK_FLAG_BACKWARD);
-        vmap["pos"] = pos;
+        decodeCmd = DecoderCommand::decode(pos);
     }
     else if (type == SEEK_LEFT_KEY) {
         av_seek_frame(m_formatContext, m_videoStreamIndex, pos / av_q2d(m_videoStream->time_base), AVSEEK_FLAG_BACKWARD);
@@ -960,8 +919,8 @@ void AVDecoder::doSeekVideo(double pos, SEEK_Type type)
     }
     m_opeMtx.unlock();
 
-//    requestDecode(vmap);
-    doDecode(vmap);
+    decodeCmd.token = token;
+    doDecode(decodeCmd);
 
     qDebug() << "doSeekVideo() cost" << t.elapsed() << "ms";
 
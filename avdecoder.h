@@ -16,6 +16,8 @@ extern "C"
 }
 
 #include "avdecodercore.h"
+#include "decodercommandqueue.h"
+#include "iointerrupter.h"
 
 #ifndef TYPEDEF_SPAVFRAME
 #define TYPEDEF_SPAVFRAME
@@ -118,36 +120,20 @@ signals:
     void seekingStateChanged(bool isSeeking);
 
 protected:
-    enum REQUEST_ID {
-        REQUEST_DECODE,
-        REQUEST_AUDIO_SEEK,
-        REQUEST_VIDEO_SEEK,
-        REQUEST_QUIT,
-    };
-
-    struct Request {
-        Request(REQUEST_ID _rid, QVariant _p = QVariant()) : rid(_rid), p1(_p) {}
-        REQUEST_ID rid;
-        QVariant   p1;
-    };
-
     void setDecodingState(DECODING_State decodingState);
     void setSeekingState(bool isSeeking);
 
     Q_INVOKABLE void handleRequests();
 
-    void pushRequest(const Request &req);
-    void clearRequestList();
-    void removeDecodeRequests();
-
-    void requestDecode(QVariant p = QVariant());
+    void requestDecode();
     void requestSeekAudio(double pos);
     void requestSeekVideo(double pos, SEEK_Type type);
     void requestQuit();
 
-    void doDecode(QVariant p);
+    // a command with a position drops the frames before it
+    void doDecode(const DecoderCommand &cmd);
     void doSeekAudio(double pos);
-    void doSeekVideo(double pos, SEEK_Type type);
+    void doSeekVideo(double pos, SEEK_Type type, int token = 0);
 
 private:
     QString m_file;
@@ -158,7 +144,7 @@ private:
     DECODING_State m_decodingState;
 
     QThread m_thread;
-    QList<Request> m_requestList;
+    DecoderCommandQueue m_commands;
 
     AVFormatContext *m_formatContext;
     AVStream *m_videoStream, *m_audioStream;
@@ -175,8 +161,10 @@ private:
     QList<VideoData> m_videoDatas;
     int m_videoMinBufferFrameCount;
 
-    QMutex m_reqMtx, m_dataMtx, m_opeMtx;
-    QWaitCondition m_cond;
+    // seeks and unload() abort what the decode thread is reading
+    IOInterrupter m_interrupter;
+
+    QMutex m_dataMtx, m_opeMtx;
 
     bool m_isSeeking;
 };
@@ -1,4 +1,19 @@
 #include "avdecodercore.h"
+#include "smartmutex.h"
+
+// upper bound of packets buffered per stream by the shared demuxer
+#define MAX_PACKET_QUEUE_SIZE   (16 * 1024 * 1024)
+#define MAX_REPLAY_PACKETS      256
+
+// decoder threads picked for one video stream at most
+#define MAX_DECODE_THREADS      16
+// frames decoded between two looks at the decode time
+#define DECODE_TUNE_FRAMES      100
+// video is decoded down to 1/8 of its size at most
+#define MAX_SCALE_SHIFT         3
+
+// decoder threads of the video streams enabled by every player in the process
+static QAtomicInt s_videoDecodeThreads;
 
 static char *iav_err2str(int eid)
 {
@@ -7,26 +22,26 @@ static char *iav_err2str(int eid)
     return av_make_error_string(s.data(), 128, eid);
 }
 
-static void deleteAVPacket(AVPacket *pkt)
-{
-    av_packet_unref(pkt);
-    delete pkt;
-}
-
 static void freeAVFarme(AVFrame *frame)
 {
     av_frame_free(&frame);
 }
 
-static void freeSwrContext(SwrContext *cxt)
-{
-    swr_free(&cxt);
-}
-
 AVDecoderCore::AVDecoderCore()
-    : m_formatContext(0)
+    : m_probeSize(0)
+    , m_analyzeDuration(0.0)
+    , m_videoDecodeThreads(0)
+    , m_videoDecodeThreadType(FF_THREAD_FRAME | FF_THREAD_SLICE)
+    , m_formatContext(0)
+    , m_demuxSerial(0)
+    , m_demuxSeekPos(-1.0)
+    , m_demuxSeekFlags(0)
 {
     qRegisterMetaType<SPAVFrame>("SPAVFrame");
+
+    av_init_packet(&m_demuxPacket);
+    m_demuxPacket.data = NULL;
+    m_demuxPacket.size = 0;
 }
 
 AVDecoderCore::~AVDecoderCore()
@@ -47,16 +62,14 @@ bool AVDecoderCore::load(const QString &file)
     unload();
 
     av_register_all();
-    m_formatContext = avformat_alloc_context();
-    int result = avformat_open_input(&m_formatContext, file.toStdString().c_str(),NULL,NULL);
-    if (result < 0){
+    if (!openFormatContext(file, &m_formatContext)) {
         qDebug() <<  __PRETTY_FUNCTION__ << "failed to do avformat_open_input";
         unload();
         return false;
     }
 
     //获取媒体流信息
-    result = avformat_find_stream_info(m_formatContext,NULL);
+    int result = avformat_find_stream_info(m_formatContext,NULL);
     if (result < 0){
         qDebug() <<  __PRETTY_FUNCTION__ << "failed to do avformat_find_stream_info";
         unload();
@@ -142,8 +155,6 @@ bool AVDecoderCore::load(const QString &file)
 
                 vsp->streamParty.streamIndex = i;
                 vsp->streamParty.streamType = type;
-                vsp->streamParty2.streamIndex = i;
-                vsp->streamParty2.streamType = type;
 
                 if (stream->duration > 0) {
                     vsp->duration = stream->duration * av_q2d(stream->time_base);
@@ -204,9 +215,10 @@ bool AVDecoderCore::load(const QString &file)
         }
     }
 
-    avformat_close_input(&m_formatContext);
-    avformat_free_context(m_formatContext);
-    m_formatContext = 0;
+    // keep the probed context open, it becomes the demuxer of the enabled streams
+    m_demuxSerial = 0;
+    m_demuxSeekPos = -1.0;
+    m_demuxSeekFlags = 0;
 
     m_file = file;
     return true;
@@ -214,6 +226,8 @@ bool AVDecoderCore::load(const QString &file)
 
 void AVDecoderCore::unload()
 {
+    interruptIO();
+
     for (int i = 0; i < m_audioStreamParties.count(); ++i) {
         disableAudioStream(i);
         delete m_audioStreamParties[i];
@@ -236,11 +250,7 @@ void AVDecoderCore::unload()
     }
     m_subtitleStreamParties.clear();
 
-    if (m_formatContext) {
-        avformat_close_input(&m_formatContext);
-        avformat_free_context(m_formatContext);
-        m_formatContext = 0;
-    }
+    uninitDemuxer();
 
     m_file.clear();
 }
@@ -255,6 +265,63 @@ QString AVDecoderCore::getFile()
     return m_file;
 }
 
+void AVDecoderCore::interruptIO()
+{
+    m_demuxInterrupter.interrupt();
+}
+
+void AVDecoderCore::setProbeSize(int64_t size)
+{
+    if (size < 0) {
+        return;
+    }
+    m_probeSize = size;
+}
+
+int64_t AVDecoderCore::getProbeSize()
+{
+    return m_probeSize;
+}
+
+void AVDecoderCore::setAnalyzeDuration(double duration)
+{
+    if (duration < 0.0) {
+        return;
+    }
+    m_analyzeDuration = duration;
+}
+
+double AVDecoderCore::getAnalyzeDuration()
+{
+    return m_analyzeDuration;
+}
+
+void AVDecoderCore::setVideoDecodeThreads(int count)
+{
+    if (count < 0) {
+        return;
+    }
+    m_videoDecodeThreads = qMin(count, MAX_DECODE_THREADS);
+}
+
+int AVDecoderCore::getVideoDecodeThreads()
+{
+    return m_videoDecodeThreads;
+}
+
+void AVDecoderCore::setVideoDecodeThreadType(int type)
+{
+    if ((type & (FF_THREAD_FRAME | FF_THREAD_SLICE)) == 0) {
+        return;
+    }
+    m_videoDecodeThreadType = type & (FF_THREAD_FRAME | FF_THREAD_SLICE);
+}
+
+int AVDecoderCore::getVideoDecodeThreadType()
+{
+    return m_videoDecodeThreadType;
+}
+
 void AVDecoderCore::showInfo()
 {
     if (!isLoaded()) {
@@ -379,7 +446,7 @@ bool AVDecoderCore::enableAudioStream(int index)
     }
 
     AudioStreamParty *asp = m_audioStreamParties[index];
-    if (!initStreamParty(&(asp->streamParty), m_file)) {
+    if (!initStreamParty(&(asp->streamParty))) {
         return false;
     }
     return true;
@@ -396,6 +463,9 @@ void AVDecoderCore::disableAudioStream(int index)
 
     AudioStreamParty *asp = m_audioStreamParties[index];
     uninitStreamParty(&(asp->streamParty));
+    if (asp->swrContext != 0) {
+        swr_free(&(asp->swrContext));
+    }
 }
 
 bool AVDecoderCore::isAudioStreamEnabled(int index)
@@ -403,7 +473,7 @@ bool AVDecoderCore::isAudioStreamEnabled(int index)
     if (index < 0 || index >= m_audioStreamParties.count()) {
         return false;
     }
-    return (m_audioStreamParties[index]->streamParty.formatContext != 0);
+    return (m_audioStreamParties[index]->streamParty.codecContext != 0);
 }
 
 bool AVDecoderCore::hasEnabledAudioStream()
@@ -592,20 +662,108 @@ bool AVDecoderCore::seekAudio(int index, double pos)
         return false;
     }
 
-    StreamParty &sp = m_audioStreamParties[index]->streamParty;
-    avcodec_flush_buffers(sp.codecContext);
-    int averr = av_seek_frame(sp.formatContext,
-                              sp.streamIndex,
-                              pos / av_q2d(sp.stream->time_base),
-                              AVSEEK_FLAG_BACKWARD);
-    if (averr < 0) {
-        qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame" << averr << iav_err2str(averr) << pos;
+    AudioStreamParty *asp = m_audioStreamParties[index];
+    asp->streamParty.ioGeneration = m_demuxInterrupter.getGeneration();
+    if (!seekStreamParty(&(asp->streamParty), pos, AVSEEK_FLAG_BACKWARD)) {
         return false;
     }
+    // drop the samples the resampler still holds from before the seek
+    if (asp->swrContext != 0) {
+        swr_init(asp->swrContext);
+    }
     return true;
 }
 
-int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, double &duration)
+int AVDecoderCore::updateSwrContext(AVDecoderCore::AudioStreamParty *asp, const AVFrame *frame)
+{
+    AVSampleFormat inputSampleFormat = (frame->format != AV_SAMPLE_FMT_NONE) ? (AVSampleFormat)frame->format
+                                                                            : (AVSampleFormat)asp->streamParty.codecPar->format;
+    if (asp->swrContext != 0
+            && asp->swrInputSampleFormat == inputSampleFormat
+            && asp->swrInputChannelLayout == frame->channel_layout
+            && asp->swrInputSampleRate == frame->sample_rate) {
+        return 0;
+    }
+
+    qDebug() <<  __PRETTY_FUNCTION__ << "format:" << inputSampleFormat
+             << "channel layout:" << frame->channel_layout << "sample rate:" << frame->sample_rate;
+
+    if (asp->swrContext != 0) {
+        swr_free(&(asp->swrContext));
+    }
+    SwrContext *swr = swr_alloc();
+    if (!swr) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to alloc SwrContext";
+        return AVERROR(ENOMEM);
+    }
+
+    // the output format is fixed for the stream, the ring buffer and the
+    // audio device were set up with it
+    av_opt_set_channel_layout(swr, "in_channel_layout",  frame->channel_layout, 0);
+    av_opt_set_channel_layout(swr, "out_channel_layout", asp->outputChannelLayout,  0);
+    av_opt_set_int(swr, "in_sample_rate", frame->sample_rate, 0);
+    av_opt_set_int(swr, "out_sample_rate", asp->outputSampleRate, 0);
+    av_opt_set_sample_fmt(swr, "in_sample_fmt",  inputSampleFormat, 0);
+    av_opt_set_sample_fmt(swr, "out_sample_fmt", asp->outputSampleFormat, 0);
+
+    int averr = 0;
+    if ((averr = swr_init(swr)) < 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to init swr," << averr << iav_err2str(averr);
+        swr_free(&swr);
+        return AVERROR_UNKNOWN;
+    }
+
+    asp->swrContext = swr;
+    asp->swrInputSampleFormat = inputSampleFormat;
+    asp->swrInputChannelLayout = frame->channel_layout;
+    asp->swrInputSampleRate = frame->sample_rate;
+    return 0;
+}
+
+int AVDecoderCore::convertAudio(AVDecoderCore::AudioStreamParty *asp, AudioRingBuffer *buffer, const uint8_t **in, int inCount)
+{
+    // an empty but non-null input drains what the resampler holds without
+    // putting it into flush mode, one pointer per possible input plane
+    const uint8_t *noInput[64] = { 0 };
+    if (in == 0) {
+        in = noInput;
+        inCount = 0;
+    }
+
+    int written = 0;
+    for (int i = 0; i < 2; ++i) {
+        int size = 0;
+        uint8_t *span = (uint8_t*)buffer->getWriteSpan(size);
+        int frames = size / asp->outputBytesPerFrame;
+        if (frames <= 0) {
+            break;
+        }
+        int nb = swr_convert(asp->swrContext, &span, frames, in, inCount);
+        if (nb < 0) {
+            qDebug() <<  __PRETTY_FUNCTION__ << "failed to convert," << nb << iav_err2str(nb);
+            return nb;
+        }
+        buffer->commitWrite(nb * asp->outputBytesPerFrame);
+        written += nb;
+        in = noInput;
+        inCount = 0;
+        if (nb < frames) {
+            break;
+        }
+    }
+
+    // the buffer is full, the resampler keeps the rest for the next call
+    if (inCount > 0) {
+        int nb = swr_convert(asp->swrContext, 0, 0, in, inCount);
+        if (nb < 0) {
+            qDebug() <<  __PRETTY_FUNCTION__ << "failed to convert," << nb << iav_err2str(nb);
+            return nb;
+        }
+    }
+    return written;
+}
+
+int AVDecoderCore::getAudioNextFrame(int index, AudioRingBuffer *buffer)
 {
     int averr = AVERROR_UNKNOWN;
     if (index < 0 || index > m_audioStreamParties.count()) {
@@ -614,17 +772,34 @@ int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, d
     if (!isAudioStreamEnabled(index)) {
         return averr;
     }
+    if (buffer == 0 || buffer->getBytesPerFrame() != m_audioStreamParties[index]->outputBytesPerFrame) {
+        return averr;
+    }
 
-    data.clear();
-    pts = 0.0;
-    duration = 0.0;
-    StreamParty &sp = m_audioStreamParties[index]->streamParty;
-    while (1) {
-        AVPacket *avPacket = new AVPacket;
-        QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
-        av_init_packet(avPacket);
+    AudioStreamParty *asp = m_audioStreamParties[index];
+    StreamParty &sp = asp->streamParty;
+    sp.ioGeneration = m_demuxInterrupter.getGeneration();
+
+    // samples left in the resampler when the buffer was full go first
+    if (asp->swrContext != 0 && swr_get_out_samples(asp->swrContext, 0) > 0) {
+        int nb = convertAudio(asp, buffer, 0, 0);
+        if (nb < 0) {
+            return nb;
+        }
+        if (nb > 0) {
+            return 0;
+        }
+    }
 
-        if ((averr = av_read_frame(sp.formatContext, avPacket)) != 0) {
+    SPAVFrame spAVFrame = sp.framePool->get();
+    if (spAVFrame.isNull()) {
+        return AVERROR(ENOMEM);
+    }
+    AVFrame *pAVFrame = spAVFrame.data();
+    int written = 0;
+    while (1) {
+        QSharedPointer<AVPacket> spAVPacket;
+        if ((averr = readPacket(&sp, spAVPacket)) != 0) {
             if (averr == AVERROR_EOF) {
                 qDebug() <<  __PRETTY_FUNCTION__ << "decode end of file";
             }
@@ -633,10 +808,7 @@ int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, d
             }
             return averr;
         }
-
-        if (avPacket->stream_index != sp.streamIndex) {
-            continue;
-        }
+        AVPacket *avPacket = spAVPacket.data();
 
 //        qDebug() <<  __PRETTY_FUNCTION__
 //                 << "packet pts:" << av_q2d(m_audioStreamParty->streamParty.stream->time_base) * avPacket->pts
@@ -648,8 +820,6 @@ int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, d
             continue;
         }
 
-        AVFrame *pAVFrame = av_frame_alloc();
-        SPAVFrame spAVFrame(pAVFrame, freeAVFarme);
         while (1) {
             if ((averr = avcodec_receive_frame(sp.codecContext, pAVFrame)) != 0) {
                 if (averr == AVERROR(EAGAIN)) {
@@ -657,7 +827,7 @@ int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, d
                 }
                 qDebug() <<  __PRETTY_FUNCTION__ << "failed to receive frame," << averr << iav_err2str(averr);
                 if (averr == AVERROR_EOF) {
-                    return data.size() > 0;
+                    return (written > 0) ? 0 : averr;
                 }
                 return averr;
             }
@@ -674,66 +844,39 @@ int AVDecoderCore::getAudioNextFrame(int index, QByteArray &data, double &pts, d
                 pAVFrame->channels = av_get_channel_layout_nb_channels(pAVFrame->channel_layout);
             }
 
-            int outputChannels = (pAVFrame->channels > 2) ? 2 : pAVFrame->channels;
-            uint64_t outputChannelLayout = (pAVFrame->channels > 2) ? AV_CH_LAYOUT_STEREO : pAVFrame->channel_layout;
-
-            SwrContext *swr = swr_alloc();
-            if (!swr) {
-                qDebug() <<  __PRETTY_FUNCTION__ << "failed to alloc SwrContext";
-                return AVERROR(ENOMEM);
-            }
-            QSharedPointer<SwrContext> spSwr(swr, freeSwrContext);
-
-            av_opt_set_channel_layout(swr, "in_channel_layout",  pAVFrame->channel_layout, 0);
-            av_opt_set_channel_layout(swr, "out_channel_layout", outputChannelLayout,  0);
-            av_opt_set_int(swr, "in_sample_rate", pAVFrame->sample_rate, 0);
-            av_opt_set_int(swr, "out_sample_rate", pAVFrame->sample_rate, 0);
-            av_opt_set_sample_fmt(swr, "in_sample_fmt",  (AVSampleFormat)sp.codecPar->format, 0);
-            av_opt_set_sample_fmt(swr, "out_sample_fmt", m_audioStreamParties[index]->outputSampleFormat, 0);
-
-//            SwrContext *swr = swr_alloc_set_opts(NULL,  // we're allocating a new context
-//                                pAVFrame->channel_layout,               // out_ch_layout
-//                                m_audioOutSampleFmt,                    // out_sample_fmt
-//                                pAVFrame->sample_rate,                  // out_sample_rate
-//                                pAVFrame->channel_layout,               // in_ch_layout
-//                                (AVSampleFormat)pAVFrame->format,       // in_sample_fmt
-//                                pAVFrame->sample_rate,                  // in_sample_rate
-//                                0,                    // log_offset
-//                                NULL);                // log_ctx
-
-            if ((averr = swr_init(swr)) < 0) {
-                qDebug() <<  __PRETTY_FUNCTION__ << "failed to init swr," << averr << iav_err2str(averr);
-                return AVERROR_UNKNOWN;
+            if ((averr = updateSwrContext(asp, pAVFrame)) < 0) {
+                return averr;
             }
 
-            AVFrame *pAVFrameOut = av_frame_alloc();
-            QSharedPointer<AVFrame> spAVFrameOut(pAVFrameOut, freeAVFarme);
-
-            int dst_nb_samples = av_rescale_rnd(swr_get_delay(swr, pAVFrame->sample_rate) + pAVFrame->nb_samples,
-                                                pAVFrame->sample_rate, pAVFrame->sample_rate, AV_ROUND_INF);
-            pAVFrameOut->format = m_audioStreamParties[index]->outputSampleFormat;
-            pAVFrameOut->nb_samples = dst_nb_samples;
-            pAVFrameOut->channel_layout = outputChannelLayout;
-            if ((averr = av_frame_get_buffer(pAVFrameOut, 1)) != 0) {
-                qDebug() <<  __PRETTY_FUNCTION__ << "failed to get frame buffer," << averr << iav_err2str(averr);
-                return AVERROR_UNKNOWN;
+            if (pAVFrame->pts != AV_NOPTS_VALUE) {
+                // the frame starts after whatever the resampler still holds
+                int64_t delay = swr_get_delay(asp->swrContext, asp->outputSampleRate);
+                buffer->addTimeMark(delay * asp->outputBytesPerFrame,
+                                    av_q2d(sp.stream->time_base) * pAVFrame->pts);
             }
 
-            int nb = swr_convert(swr, pAVFrameOut->data, dst_nb_samples, (const uint8_t**)pAVFrame->data, pAVFrame->nb_samples);
-            int data_size = outputChannels * nb * av_get_bytes_per_sample(m_audioStreamParties[index]->outputSampleFormat);
-            data += QByteArray((const char*)pAVFrameOut->data[0], data_size);
-            if (pts == 0.0) {
-                pts = av_q2d(sp.stream->time_base) * pAVFrame->pts;
+            int nb = convertAudio(asp, buffer, (const uint8_t**)pAVFrame->extended_data, pAVFrame->nb_samples);
+            if (nb < 0) {
+                continue;
             }
-            duration += av_q2d(sp.stream->time_base) * pAVFrame->pkt_duration;
+            written += nb;
         }
-        if (data.size() > 0) {
+        if (written > 0) {
             break;
         }
     }
     return 0;
 }
 
+int AVDecoderCore::getAudioAllocCount(int index)
+{
+    if (index < 0 || index >= m_audioStreamParties.count()) {
+        return 0;
+    }
+    StreamParty &sp = m_audioStreamParties[index]->streamParty;
+    return sp.packetPool->getAllocCount() + sp.framePool->getAllocCount();
+}
+
 bool AVDecoderCore::hasVideoStream()
 {
     return !m_videoStreamParties.isEmpty();
@@ -758,13 +901,27 @@ bool AVDecoderCore::enableVideoStream(int index)
     }
 
     VideoStreamParty *vsp = m_videoStreamParties[index];
-    if (!initStreamParty(&(vsp->streamParty), m_file)) {
-        return false;
-    }
-    if (!initStreamParty(&(vsp->streamParty2), m_file)) {
-        uninitStreamParty(&(vsp->streamParty));
+    StreamParty &sp = vsp->streamParty;
+    sp.threadCount = (m_videoDecodeThreads > 0) ? m_videoDecodeThreads : getAutoThreadCount();
+    sp.lowres = 0;
+    vsp->decodeTime = 0;
+    vsp->decodeFrames = 0;
+    vsp->isRetuning = false;
+    vsp->scaleShift = 0;
+    vsp->isScaleFailed = false;
+    if (!initStreamParty(&sp)) {
         return false;
     }
+    vsp->retuneThreadCount = sp.threadCount;
+    vsp->retuneLowres = sp.lowres;
+    vsp->appliedSkipLevel = SKIP_NONE;
+
+    KeyFrameIndex *kfi = new KeyFrameIndex(m_file, sp.streamIndex, sp.stream->time_base);
+    kfi->setInterrupter(&m_demuxInterrupter);
+    m_demuxMtx.lock();
+    sp.keyFrameIndex = kfi;
+    m_demuxMtx.unlock();
+    kfi->build();
     return true;
 }
 
@@ -779,7 +936,14 @@ void AVDecoderCore::disableVideoStream(int index)
 
     VideoStreamParty *vsp = m_videoStreamParties[index];
     uninitStreamParty(&(vsp->streamParty));
-    uninitStreamParty(&(vsp->streamParty2));
+    if (vsp->swsContext != 0) {
+        sws_freeContext(vsp->swsContext);
+        vsp->swsContext = 0;
+    }
+    if (vsp->streamParty.keyFrameIndex != 0) {
+        delete vsp->streamParty.keyFrameIndex;
+        vsp->streamParty.keyFrameIndex = 0;
+    }
 }
 
 bool AVDecoderCore::isVideoStreamEnabled(int index)
@@ -787,7 +951,7 @@ bool AVDecoderCore::isVideoStreamEnabled(int index)
     if (index < 0 || index >= m_videoStreamParties.count()) {
         return false;
     }
-    return (m_videoStreamParties[index]->streamParty.formatContext != 0);
+    return (m_videoStreamParties[index]->streamParty.codecContext != 0);
 }
 
 bool AVDecoderCore::hasEnabledVideoStream()
@@ -879,55 +1043,56 @@ bool AVDecoderCore::seekVideo(int index, double pos, AVDecoderCore::SEEK_Type ty
     }
 
     StreamParty &sp = m_videoStreamParties[index]->streamParty;
-    avcodec_flush_buffers(sp.codecContext);
+    sp.ioGeneration = m_demuxInterrupter.getGeneration();
+    KeyFrameIndex *kfi = sp.keyFrameIndex;
     int averr = AVERROR_UNKNOWN;
     if (type == SEEK_USER_SET) {
-        if ((averr = av_seek_frame(sp.formatContext,
-                                   sp.streamIndex,
-                                   pos / av_q2d(sp.stream->time_base),
-                                   AVSEEK_FLAG_BACKWARD)) < 0) {
-            qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame, pos:" << pos << "flag:" << AVSEEK_FLAG_BACKWARD;
+        if (!seekStreamParty(&sp, pos, AVSEEK_FLAG_BACKWARD)) {
             return false;
         }
         SPAVFrame frame;
         if ((averr = getVideoNextFrame(index, frame, pos)) < 0) {
             if (averr == AVERROR_EOF) {
                 qDebug("%s cannot seek to %f, try to seek %f",  __PRETTY_FUNCTION__, pos, pos - 1);
-                return seekVideo(pos - 1, type);
+                return seekVideo(index, pos - 1, type);
             }
             return false;
         }
     }
     else if (type == SEEK_LEFT_KEY) {
-        if ((averr = av_seek_frame(sp.formatContext,
-                                   sp.streamIndex,
-                                   pos / av_q2d(sp.stream->time_base),
-                                   AVSEEK_FLAG_BACKWARD)) < 0) {
-            qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame, pos:" << pos << "flag:" << AVSEEK_FLAG_BACKWARD;
+        double kpos = pos;
+        if (kfi != 0) {
+            kfi->findLeft(pos, kpos);
+        }
+        if (!seekStreamParty(&sp, kpos, AVSEEK_FLAG_BACKWARD)) {
             return false;
         }
         SPAVFrame frame;
         if ((averr = getVideoNextFrame(index, frame)) < 0) {
             if (averr == AVERROR_EOF) {
                 qDebug("%s cannot seek to %f, try to seek %f",  __PRETTY_FUNCTION__, pos, pos - 1);
-                return seekVideo(pos - 1, type);
+                return seekVideo(index, pos - 1, type);
             }
             return false;
         }
     }
     else if (type == SEEK_RIGHT_KEY) {
-        if ((averr = av_seek_frame(sp.formatContext,
-                                   sp.streamIndex,
-                                   pos / av_q2d(sp.stream->time_base),
-                                   AVSEEK_FLAG_FRAME)) < 0) {
-            qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame, pos:" << pos << "flag:" << AVSEEK_FLAG_FRAME;
+        // the index may know the next key frame exactly, otherwise leave it
+        // to the demuxer by seeking without AVSEEK_FLAG_BACKWARD
+        double kpos = pos;
+        if (kfi != 0 && kfi->findRight(pos, kpos)) {
+            if (!seekStreamParty(&sp, kpos, AVSEEK_FLAG_BACKWARD)) {
+                return false;
+            }
+        }
+        else if (!seekStreamParty(&sp, pos, 0)) {
             return false;
         }
         SPAVFrame frame;
         if ((averr = getVideoNextFrame(index, frame)) < 0) {
             if (averr == AVERROR_EOF) {
                 qDebug("%s cannot seek to %f, try to seek %f",  __PRETTY_FUNCTION__, pos, pos - 1);
-                return seekVideo(pos - 1, type);
+                return seekVideo(index, pos - 1, type);
             }
             return false;
         }
@@ -951,40 +1116,17 @@ bool AVDecoderCore::getVideoSeekPos(int index, double t, AVDecoderCore::SEEK_POS
         return false;
     }
 
-    StreamParty &sp = m_videoStreamParties[index]->streamParty2;
+    KeyFrameIndex *kfi = m_videoStreamParties[index]->streamParty.keyFrameIndex;
     if (type == SEEK_POS_LEFT_KEY || type == SEEK_POS_RIGHT_KEY) {
-        int AVSEEK_FLAG = type == SEEK_POS_LEFT_KEY ? AVSEEK_FLAG_BACKWARD : AVSEEK_FLAG_FRAME;
-        avcodec_flush_buffers(sp.codecContext);
-        int averr = av_seek_frame(sp.formatContext,
-                                  sp.streamIndex,
-                                  t / av_q2d(sp.stream->time_base),
-                                  AVSEEK_FLAG);
-        if (averr < 0) {
-            qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame" << averr << iav_err2str(averr) << t << type;
+        if (kfi == 0) {
             return false;
         }
-        while (1) {
-            AVPacket *avPacket = new AVPacket;
-            QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
-            av_init_packet(avPacket);
-            averr = av_read_frame(sp.formatContext, avPacket);
-            if (averr != 0) {
-                if (averr == AVERROR_EOF) {
-                    return getVideoSeekPos(index, t - 1, type, spos);
-                }
-                else {
-                    qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_read_frame()" << averr << iav_err2str(averr) << t << type;
-                    return false;
-                }
-            }
-            if (avPacket->stream_index != sp.streamIndex) {
-                continue;
-            }
-            if (avPacket->flags & AV_PKT_FLAG_KEY) {
-                spos = av_q2d(sp.stream->time_base) * avPacket->pts;
-                return true;
-            }
+        bool left = (type == SEEK_POS_LEFT_KEY);
+        if (left ? kfi->findLeft(t, spos) : kfi->findRight(t, spos)) {
+            return true;
         }
+        // nothing around t has been demuxed yet
+        return kfi->probe(t, left, spos);
     }
     else if (type == SEEK_POS_NEAREST) {
         double leftPts = t, rightPts = t;
@@ -1022,17 +1164,11 @@ bool AVDecoderCore::getVideoKeyFramePosList(int index, QList<double> &posList)
         return false;
     }
 
-    double duration = getVideoDuration(index);
-    double t = 0.0;
-    while (t < duration) {
-        double pos;
-        if (!getVideoSeekPos(index, t, SEEK_POS_LEFT_KEY, pos)) {
-            return false;
-        }
-        posList.append(pos);
-        t = pos + 0.1;
+    KeyFrameIndex *kfi = m_videoStreamParties[index]->streamParty.keyFrameIndex;
+    if (kfi == 0) {
+        return false;
     }
-    return true;
+    return kfi->getKeyFramePosList(posList);
 }
 
 int AVDecoderCore::getVideoNextFrame(int index, SPAVFrame &frame)
@@ -1050,6 +1186,190 @@ int AVDecoderCore::getVideoNextKeyFrame(int index, SPAVFrame &frame)
     return getVideoNextFrame(index, frame, false, 0.0, true);
 }
 
+int AVDecoderCore::getVideoAllocCount(int index)
+{
+    if (index < 0 || index >= m_videoStreamParties.count()) {
+        return 0;
+    }
+    StreamParty &sp = m_videoStreamParties[index]->streamParty;
+    return sp.packetPool->getAllocCount() + sp.framePool->getAllocCount();
+}
+
+int AVDecoderCore::getVideoDecodeThreadCount(int index)
+{
+    if (index < 0 || index >= m_videoStreamParties.count()) {
+        return 0;
+    }
+    if (!isVideoStreamEnabled(index)) {
+        return 0;
+    }
+    return m_videoStreamParties[index]->streamParty.threadCount;
+}
+
+void AVDecoderCore::setVideoSkipLevel(int index, AVDecoderCore::SKIP_Level level)
+{
+    if (index < 0 || index >= m_videoStreamParties.count()) {
+        return;
+    }
+    if (level < SKIP_NONE || level > SKIP_NON_KEY_FRAMES) {
+        return;
+    }
+    m_videoStreamParties[index]->skipLevel.store(level);
+}
+
+AVDecoderCore::SKIP_Level AVDecoderCore::getVideoSkipLevel(int index)
+{
+    if (index < 0 || index >= m_videoStreamParties.count()) {
+        return SKIP_NONE;
+    }
+    return (SKIP_Level)m_videoStreamParties[index]->skipLevel.load();
+}
+
+void AVDecoderCore::applyVideoSkipLevel(AVDecoderCore::VideoStreamParty *vsp, int level)
+{
+    if (level == vsp->appliedSkipLevel) {
+        return;
+    }
+
+    AVCodecContext *codecContext = vsp->streamParty.codecContext;
+    switch (level) {
+    case SKIP_LOOP_FILTER:
+        codecContext->skip_frame = AVDISCARD_DEFAULT;
+        codecContext->skip_loop_filter = AVDISCARD_NONREF;
+        break;
+    case SKIP_NON_REF_FRAMES:
+        codecContext->skip_frame = AVDISCARD_NONREF;
+        codecContext->skip_loop_filter = AVDISCARD_ALL;
+        break;
+    case SKIP_NON_KEY_FRAMES:
+        codecContext->skip_frame = AVDISCARD_NONKEY;
+        codecContext->skip_loop_filter = AVDISCARD_ALL;
+        break;
+    default:
+        codecContext->skip_frame = AVDISCARD_DEFAULT;
+        codecContext->skip_loop_filter = AVDISCARD_DEFAULT;
+        break;
+    }
+    qDebug() <<  __PRETTY_FUNCTION__ << "stream" << vsp->streamParty.streamIndex
+             << "skip level:" << vsp->appliedSkipLevel << "->" << level;
+    vsp->appliedSkipLevel = level;
+}
+
+void AVDecoderCore::setVideoTargetSize(int index, int width, int height)
+{
+    if (index < 0 || index >= m_videoStreamParties.count()) {
+        return;
+    }
+    if (width < 0 || height < 0) {
+        return;
+    }
+    VideoStreamParty *vsp = m_videoStreamParties[index];
+    vsp->targetWidth.store(width);
+    vsp->targetHeight.store(height);
+}
+
+void AVDecoderCore::updateVideoScale(AVDecoderCore::VideoStreamParty *vsp)
+{
+    int targetWidth = vsp->targetWidth.load(), targetHeight = vsp->targetHeight.load();
+    int shift = 0;
+    if (targetWidth > 0 && targetHeight > 0) {
+        while (shift < MAX_SCALE_SHIFT
+               && (vsp->width >> (shift + 1)) >= targetWidth
+               && (vsp->height >> (shift + 1)) >= targetHeight) {
+            ++shift;
+        }
+    }
+    if (shift == vsp->scaleShift) {
+        return;
+    }
+
+    qDebug() <<  __PRETTY_FUNCTION__ << "stream" << vsp->streamParty.streamIndex
+             << "decode at" << (vsp->width >> shift) << "x" << (vsp->height >> shift);
+    vsp->scaleShift = shift;
+    // the codec changes its resolution when it is reopened at a key packet
+    vsp->retuneLowres = qMin(shift, (int)vsp->streamParty.codecContext->codec->max_lowres);
+}
+
+int AVDecoderCore::scaleVideoFrame(AVDecoderCore::VideoStreamParty *vsp, SPAVFrame &frame)
+{
+    int width = vsp->width >> vsp->scaleShift, height = vsp->height >> vsp->scaleShift;
+    if (vsp->scaleShift == 0 || vsp->isScaleFailed || frame->width <= width || frame->height <= height) {
+        // full resolution, lowres did it already, or swscale cannot
+        return 0;
+    }
+
+    vsp->swsContext = sws_getCachedContext(vsp->swsContext,
+                                           frame->width, frame->height, (AVPixelFormat)frame->format,
+                                           width, height, (AVPixelFormat)frame->format,
+                                           SWS_FAST_BILINEAR, NULL, NULL, NULL);
+    if (vsp->swsContext == 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "stream" << vsp->streamParty.streamIndex
+                 << "cannot scale" << av_get_pix_fmt_name((AVPixelFormat)frame->format) << "frames, left as they are";
+        vsp->isScaleFailed = true;
+        return 0;
+    }
+
+    SPAVFrame scaled = vsp->streamParty.framePool->get();
+    if (scaled.isNull()) {
+        return AVERROR(ENOMEM);
+    }
+    scaled->format = frame->format;
+    scaled->width = width;
+    scaled->height = height;
+    int averr = av_frame_get_buffer(scaled.data(), 32);
+    if (averr < 0) {
+        return averr;
+    }
+    av_frame_copy_props(scaled.data(), frame.data());
+    if (sws_scale(vsp->swsContext, frame->data, frame->linesize, 0, frame->height,
+                  scaled->data, scaled->linesize) <= 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "stream" << vsp->streamParty.streamIndex
+                 << "failed to scale" << av_get_pix_fmt_name((AVPixelFormat)frame->format) << "frames, left as they are";
+        vsp->isScaleFailed = true;
+        return 0;
+    }
+    frame = scaled;
+    return 0;
+}
+
+int AVDecoderCore::getAutoThreadCount()
+{
+    // start with the cores the other players have left, at least one
+    int cores = qMax(1, QThread::idealThreadCount());
+    return qBound(1, cores - s_videoDecodeThreads.load(), MAX_DECODE_THREADS);
+}
+
+void AVDecoderCore::tuneVideoDecodeThreads(AVDecoderCore::VideoStreamParty *vsp)
+{
+    StreamParty &sp = vsp->streamParty;
+    double frameTime = (double)vsp->decodeTime / vsp->decodeFrames / 1000000000.0;
+    double frameDuration = (vsp->frameRate > 0.0) ? 1.0 / vsp->frameRate : 0.04;
+    vsp->decodeTime = 0;
+    vsp->decodeFrames = 0;
+
+    int cores = qMax(1, QThread::idealThreadCount());
+    int freeCores = cores - s_videoDecodeThreads.load();
+    int count = sp.threadCount;
+    if (frameTime > frameDuration * 0.5 && freeCores > 0) {
+        // falling behind, take more of the idle cores
+        count = qMin(qMin(count * 2, count + freeCores), MAX_DECODE_THREADS);
+    }
+    else if (frameTime < frameDuration * 0.1 && count > 1) {
+        // far ahead, leave cores to the other players
+        count = qMax(1, count / 2);
+    }
+    else if (freeCores < 0 && count > 1) {
+        // the players together ask for more threads than there are cores
+        count = qMax(1, count + freeCores);
+    }
+
+    if (count != sp.threadCount) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "decode time per frame:" << frameTime
+                 << "threads:" << sp.threadCount << "->" << count;
+        vsp->retuneThreadCount = count;
+    }
+}
+
 double AVDecoderCore::calculateVideoTimestamp(int index, long long t)
 {
     if (index < 0 || index >= m_videoStreamParties.count()) {
@@ -1081,63 +1401,167 @@ bool AVDecoderCore::getCover(int index, SPAVFrame &frame)
     return true;
 }
 
-bool AVDecoderCore::initStreamParty(AVDecoderCore::StreamParty *sp, const QString &file)
+bool AVDecoderCore::initDemuxer()
 {
-    if (sp == 0 || sp->streamIndex < 0) {
-        return false;
+    if (m_formatContext != 0) {
+        return true;
     }
-    if (file.isEmpty()) {
+    if (m_file.isEmpty()) {
         return false;
     }
 
-    AVFormatContext *formatContext = avformat_alloc_context();
-    if (avformat_open_input(&formatContext, file.toStdString().c_str(), NULL, NULL) < 0) {
-        avformat_free_context(formatContext);
+    AVFormatContext *formatContext = 0;
+    if (!openFormatContext(m_file, &formatContext)) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to do avformat_open_input";
         return false;
     }
     if (avformat_find_stream_info(formatContext, NULL) < 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to do avformat_find_stream_info";
         avformat_close_input(&formatContext);
         avformat_free_context(formatContext);
         return false;
     }
 
+    m_formatContext = formatContext;
+    m_demuxSerial = 0;
+    m_demuxSeekPos = -1.0;
+    m_demuxSeekFlags = 0;
+    return true;
+}
+
+void AVDecoderCore::uninitDemuxer()
+{
+    if (m_formatContext == 0) {
+        return;
+    }
+
+    SmartMutex demuxMtx(&m_demuxMtx);
+    foreach (StreamParty *sp, m_demuxStreamParties) {
+        clearPacketQueue(sp);
+        clearReplayPackets(sp);
+    }
+    m_demuxStreamParties.clear();
+    av_packet_unref(&m_demuxPacket);
+
+    avformat_close_input(&m_formatContext);
+    avformat_free_context(m_formatContext);
+    m_formatContext = 0;
+}
+
+bool AVDecoderCore::initStreamParty(AVDecoderCore::StreamParty *sp)
+{
+    if (sp == 0 || sp->streamIndex < 0) {
+        return false;
+    }
+    if (!initDemuxer()) {
+        return false;
+    }
+    if (!openStreamCodec(sp, m_formatContext)) {
+        return false;
+    }
+
+    SmartMutex demuxMtx(&m_demuxMtx);
+    sp->serial = m_demuxSerial;
+    m_demuxStreamParties.insert(sp->streamIndex, sp);
+    return true;
+}
+
+bool AVDecoderCore::openFormatContext(const QString &file, AVFormatContext **formatContext)
+{
+    AVDictionary *options = 0;
+    if (m_probeSize > 0) {
+        av_dict_set_int(&options, "probesize", m_probeSize, 0);
+    }
+    if (m_analyzeDuration > 0.0) {
+        av_dict_set_int(&options, "analyzeduration", m_analyzeDuration * AV_TIME_BASE, 0);
+    }
+
+    *formatContext = avformat_alloc_context();
+    m_demuxInterrupter.install(*formatContext);
+    m_demuxInterrupter.arm();
+    int averr = avformat_open_input(formatContext, file.toStdString().c_str(), NULL, &options);
+    av_dict_free(&options);
+    if (averr < 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to do avformat_open_input" << averr << iav_err2str(averr);
+        *formatContext = 0;
+        return false;
+    }
+    return true;
+}
+
+bool AVDecoderCore::openStreamCodec(AVDecoderCore::StreamParty *sp, AVFormatContext *formatContext)
+{
     if (sp->streamIndex >= formatContext->nb_streams) {
-        avformat_close_input(&formatContext);
-        avformat_free_context(formatContext);
         return false;
     }
 
     AVStream *stream = formatContext->streams[sp->streamIndex];
     AVCodecParameters *codecPar = stream->codecpar;
+    AVCodecContext *codecContext = openCodecContext(codecPar, sp->threadCount, sp->lowres);
+    if (codecContext == 0) {
+        return false;
+    }
+    sp->lowres = codecContext->lowres;
+
+    sp->formatContext = formatContext;
+    sp->stream = stream;
+    sp->codecPar = codecPar;
+    sp->codecContext = codecContext;
+    if (sp->threadCount > 0) {
+        s_videoDecodeThreads.fetchAndAddOrdered(sp->threadCount);
+    }
+    return true;
+}
+
+AVCodecContext *AVDecoderCore::openCodecContext(AVCodecParameters *codecPar, int threadCount, int lowres)
+{
     AVCodec *codec = avcodec_find_decoder(codecPar->codec_id);
     if (codec == 0) {
-        avformat_close_input(&formatContext);
-        avformat_free_context(formatContext);
-        return false;
+        return 0;
     }
     AVCodecContext *codecContext = avcodec_alloc_context3(codec);
     if (codecContext == 0) {
-        avformat_close_input(&formatContext);
-        avformat_free_context(formatContext);
-        return false;
+        return 0;
     }
     if (avcodec_parameters_to_context(codecContext, codecPar) < 0) {
         avcodec_free_context(&codecContext);
-        avformat_close_input(&formatContext);
-        avformat_free_context(formatContext);
-        return false;
+        return 0;
+    }
+    if (threadCount > 0) {
+        codecContext->thread_count = threadCount;
+        codecContext->thread_type = m_videoDecodeThreadType;
+    }
+    if (lowres > 0) {
+        codecContext->lowres = qMin(lowres, (int)codec->max_lowres);
     }
     if (avcodec_open2(codecContext, codec, NULL) < 0) {
         avcodec_free_context(&codecContext);
-        avformat_close_input(&formatContext);
-        avformat_free_context(formatContext);
+        return 0;
+    }
+    return codecContext;
+}
+
+bool AVDecoderCore::reopenStreamCodec(AVDecoderCore::StreamParty *sp, int threadCount, int lowres)
+{
+    if (sp->codecContext == 0 || threadCount < 0 || lowres < 0) {
+        return false;
+    }
+    AVCodecContext *codecContext = openCodecContext(sp->codecPar, threadCount, lowres);
+    if (codecContext == 0) {
         return false;
     }
 
-    sp->formatContext = formatContext;
-    sp->stream = stream;
-    sp->codecPar = codecPar;
+    // the codec is only used by the thread of its stream, the lock keeps
+    // the demuxer from flushing it halfway through the swap
+    m_demuxMtx.lock();
+    AVCodecContext *oldCodecContext = sp->codecContext;
     sp->codecContext = codecContext;
+    m_demuxMtx.unlock();
+    avcodec_free_context(&oldCodecContext);
+
+    s_videoDecodeThreads.fetchAndAddOrdered(threadCount - sp->threadCount);
+    sp->threadCount = threadCount;
+    sp->lowres = codecContext->lowres;
     return true;
 }
 
@@ -1147,11 +1571,28 @@ void AVDecoderCore::uninitStreamParty(AVDecoderCore::StreamParty *sp)
         return;
     }
 
+    if (sp->codecContext != 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "stream" << sp->streamIndex << "allocated"
+                 << sp->packetPool->getAllocCount() << "packets and"
+                 << sp->framePool->getAllocCount() << "frames";
+    }
+
+    bool isShared = (sp->formatContext != 0 && sp->formatContext == m_formatContext);
+    if (isShared) {
+        SmartMutex demuxMtx(&m_demuxMtx);
+        m_demuxStreamParties.remove(sp->streamIndex);
+        clearPacketQueue(sp);
+        clearReplayPackets(sp);
+    }
+
     if (sp->codecContext != 0) {
         avcodec_close(sp->codecContext);
         avcodec_free_context(&(sp->codecContext));
+        if (sp->threadCount > 0) {
+            s_videoDecodeThreads.fetchAndAddOrdered(-sp->threadCount);
+        }
     }
-    if (sp->formatContext != 0) {
+    if (sp->formatContext != 0 && !isShared) {
         avformat_close_input(&(sp->formatContext));
         avformat_free_context(sp->formatContext);
     }
@@ -1162,6 +1603,175 @@ void AVDecoderCore::uninitStreamParty(AVDecoderCore::StreamParty *sp)
     sp->codecContext = 0;
 }
 
+int AVDecoderCore::readPacket(AVDecoderCore::StreamParty *sp, QSharedPointer<AVPacket> &packet)
+{
+    SmartMutex demuxMtx(&m_demuxMtx);
+    if (m_formatContext == 0 || sp->formatContext != m_formatContext) {
+        return AVERROR_UNKNOWN;
+    }
+
+    if (sp->serial != m_demuxSerial) {
+        // the demuxer was moved by a sibling stream, continue from there
+        avcodec_flush_buffers(sp->codecContext);
+        clearReplayPackets(sp);
+        sp->serial = m_demuxSerial;
+        sp->replayable = true;
+    }
+
+    m_demuxInterrupter.arm(sp->ioGeneration);
+    while (sp->packetQueue.isEmpty()) {
+        int averr = av_read_frame(m_formatContext, &m_demuxPacket);
+        if (averr != 0) {
+            return averr;
+        }
+        StreamParty *owner = m_demuxStreamParties.value(m_demuxPacket.stream_index, 0);
+        if (owner == 0) {
+            av_packet_unref(&m_demuxPacket);
+            continue;
+        }
+        if (owner->keyFrameIndex != 0) {
+            owner->keyFrameIndex->addPacket(&m_demuxPacket, m_demuxSerial);
+        }
+        AVPacket *avPacket = owner->packetPool->take();
+        if (avPacket == 0) {
+            av_packet_unref(&m_demuxPacket);
+            return AVERROR(ENOMEM);
+        }
+        av_packet_move_ref(avPacket, &m_demuxPacket);
+        pushPacket(owner, avPacket);
+    }
+
+    AVPacket *avPacket = sp->packetQueue.takeFirst();
+    sp->packetQueueSize -= avPacket->size;
+    if (sp->replayable) {
+        AVPacket *replayPacket = 0;
+        if (sp->replayPackets.count() < MAX_REPLAY_PACKETS
+                && (replayPacket = sp->packetPool->take()) != 0
+                && av_packet_ref(replayPacket, avPacket) == 0) {
+            sp->replayPackets.append(replayPacket);
+        }
+        else {
+            sp->packetPool->recycle(replayPacket);
+            clearReplayPackets(sp);
+        }
+    }
+    packet = sp->packetPool->wrap(avPacket);
+    return 0;
+}
+
+void AVDecoderCore::pushPacket(AVDecoderCore::StreamParty *sp, AVPacket *packet)
+{
+    sp->packetQueue.append(packet);
+    sp->packetQueueSize += packet->size;
+    if (sp->packetQueueSize <= MAX_PACKET_QUEUE_SIZE) {
+        return;
+    }
+
+    // nobody is consuming this stream, drop its oldest packets instead of
+    // buffering the whole file; video restarts from a key packet
+    qDebug() <<  __PRETTY_FUNCTION__ << "packet queue overflow, stream:" << sp->streamIndex;
+    while (!sp->packetQueue.isEmpty() && sp->packetQueueSize > MAX_PACKET_QUEUE_SIZE) {
+        AVPacket *p = sp->packetQueue.takeFirst();
+        sp->packetQueueSize -= p->size;
+        sp->packetPool->recycle(p);
+    }
+    if (sp->streamType == AVMEDIA_TYPE_VIDEO) {
+        while (!sp->packetQueue.isEmpty() && !(sp->packetQueue.front()->flags & AV_PKT_FLAG_KEY)) {
+            AVPacket *p = sp->packetQueue.takeFirst();
+            sp->packetQueueSize -= p->size;
+            sp->packetPool->recycle(p);
+        }
+    }
+}
+
+bool AVDecoderCore::requeuePacket(AVDecoderCore::StreamParty *sp, const AVPacket *packet)
+{
+    SmartMutex demuxMtx(&m_demuxMtx);
+    if (sp->serial != m_demuxSerial) {
+        return false;
+    }
+    AVPacket *avPacket = sp->packetPool->take();
+    if (avPacket == 0) {
+        return false;
+    }
+    if (av_packet_ref(avPacket, packet) != 0) {
+        sp->packetPool->recycle(avPacket);
+        return false;
+    }
+    sp->packetQueue.prepend(avPacket);
+    sp->packetQueueSize += avPacket->size;
+    // the packet would be replayed twice
+    clearReplayPackets(sp);
+    return true;
+}
+
+void AVDecoderCore::clearPacketQueue(AVDecoderCore::StreamParty *sp)
+{
+    foreach (AVPacket *p, sp->packetQueue) {
+        sp->packetPool->recycle(p);
+    }
+    sp->packetQueue.clear();
+    sp->packetQueueSize = 0;
+}
+
+void AVDecoderCore::clearReplayPackets(AVDecoderCore::StreamParty *sp)
+{
+    foreach (AVPacket *p, sp->replayPackets) {
+        sp->packetPool->recycle(p);
+    }
+    sp->replayPackets.clear();
+    sp->replayable = false;
+}
+
+bool AVDecoderCore::seekStreamParty(AVDecoderCore::StreamParty *sp, double pos, int flags)
+{
+    SmartMutex demuxMtx(&m_demuxMtx);
+    if (m_formatContext == 0 || sp->formatContext != m_formatContext) {
+        return false;
+    }
+
+    // audio and video are seeked one after another to the same position,
+    // the second one only has to catch up with the demuxer
+    if (m_demuxSerial > 0 && pos == m_demuxSeekPos && flags == m_demuxSeekFlags) {
+        if (sp->serial != m_demuxSerial) {
+            avcodec_flush_buffers(sp->codecContext);
+            clearReplayPackets(sp);
+            sp->serial = m_demuxSerial;
+            return true;
+        }
+        if (sp->replayable) {
+            avcodec_flush_buffers(sp->codecContext);
+            while (!sp->replayPackets.isEmpty()) {
+                AVPacket *p = sp->replayPackets.takeLast();
+                sp->packetQueue.prepend(p);
+                sp->packetQueueSize += p->size;
+            }
+            sp->replayable = false;
+            return true;
+        }
+    }
+
+    // seek on the default stream so that video always restarts from a key frame
+    m_demuxInterrupter.arm(sp->ioGeneration);
+    int averr = av_seek_frame(m_formatContext, -1, pos * AV_TIME_BASE, flags);
+    if (averr < 0) {
+        qDebug() <<  __PRETTY_FUNCTION__ << "failed to do av_seek_frame" << averr << iav_err2str(averr) << pos << flags;
+        return false;
+    }
+
+    foreach (StreamParty *p, m_demuxStreamParties) {
+        clearPacketQueue(p);
+        clearReplayPackets(p);
+    }
+    m_demuxSerial++;
+    m_demuxSeekPos = pos;
+    m_demuxSeekFlags = flags;
+
+    avcodec_flush_buffers(sp->codecContext);
+    sp->serial = m_demuxSerial;
+    return true;
+}
+
 //double AVDecoderCore::getAudioDuration(AVDecoderCore::AudioStreamParty *asp)
 //{
 //    if (asp == 0) {
@@ -1419,48 +2029,87 @@ int AVDecoderCore::getVideoNextFrame(int index, SPAVFrame &frame, bool specifyPo
     if (specifyPos && pos < 0) {
         return averr;
     }
-    StreamParty &sp = m_videoStreamParties[index]->streamParty;
+    VideoStreamParty *vsp = m_videoStreamParties[index];
+    StreamParty &sp = vsp->streamParty;
+    sp.ioGeneration = m_demuxInterrupter.getGeneration();
+    // reused until a frame is handed out, avcodec_receive_frame unrefs it first
+    SPAVFrame spAVFrame = sp.framePool->get();
+    if (spAVFrame.isNull()) {
+        return AVERROR(ENOMEM);
+    }
+    AVFrame *pAVFrame = spAVFrame.data();
+    updateVideoScale(vsp);
+    QElapsedTimer decodeTimer;
+    decodeTimer.start();
     while (1) {
-        AVPacket *avPacket = new AVPacket;
-        QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
-        av_init_packet(avPacket);
-        if ((averr = av_read_frame(sp.formatContext, avPacket)) != 0) {
-            if (averr == AVERROR_EOF) {
-                qDebug() <<  __PRETTY_FUNCTION__ << "decode end of file";
-            }
-            else {
-                qDebug() <<  __PRETTY_FUNCTION__ << "failed to read frame" << averr << iav_err2str(averr);
+        if (vsp->isRetuning) {
+            // hand out what the old decoder still holds, then switch
+            if (avcodec_receive_frame(sp.codecContext, pAVFrame) != 0) {
+                vsp->isRetuning = false;
+                if (reopenStreamCodec(&sp, vsp->retuneThreadCount, vsp->retuneLowres)) {
+                    qDebug() <<  __PRETTY_FUNCTION__ << "decoder threads:" << sp.threadCount << "lowres:" << sp.lowres;
+                    // the new context starts without any skipping
+                    vsp->appliedSkipLevel = SKIP_NONE;
+                }
+                else {
+                    vsp->retuneThreadCount = sp.threadCount;
+                    vsp->retuneLowres = sp.lowres;
+                }
+                continue;
             }
-            return averr;
         }
+        else {
+            QSharedPointer<AVPacket> spAVPacket;
+            if ((averr = readPacket(&sp, spAVPacket)) != 0) {
+                if (averr != AVERROR_EOF) {
+                    qDebug() <<  __PRETTY_FUNCTION__ << "failed to read frame" << averr << iav_err2str(averr);
+                    return averr;
+                }
+                // frame threads hold back the last frames of the file
+                avcodec_send_packet(sp.codecContext, NULL);
+                if (avcodec_receive_frame(sp.codecContext, pAVFrame) != 0) {
+                    qDebug() <<  __PRETTY_FUNCTION__ << "decode end of file";
+                    return AVERROR_EOF;
+                }
+            }
+            else {
+                AVPacket *avPacket = spAVPacket.data();
 
-        if (avPacket->stream_index != sp.streamIndex) {
-            continue;
-        }
+//                qDebug() <<  __PRETTY_FUNCTION__
+//                         << "packet pts:" << av_q2d(sp.stream->time_base) * avPacket->pts
+//                         << "dts:" << av_q2d(sp.stream->time_base) * avPacket->dts
+//                         << "flags:" << avPacket->flags;
 
-//        qDebug() <<  __PRETTY_FUNCTION__
-//                 << "packet pts:" << av_q2d(sp.stream->time_base) * avPacket->pts
-//                 << "dts:" << av_q2d(sp.stream->time_base) * avPacket->dts
-//                 << "flags:" << avPacket->flags;
+                if (specifyKeyFrame && !(avPacket->flags & AV_PKT_FLAG_KEY)) {
+                    continue;
+                }
 
-        if (specifyKeyFrame && !(avPacket->flags & AV_PKT_FLAG_KEY)) {
-            continue;
-        }
+                // a new decoder can only start at a key packet, which is
+                // read again once the old one is drained
+                if ((vsp->retuneThreadCount != sp.threadCount || vsp->retuneLowres != sp.lowres)
+                        && (avPacket->flags & AV_PKT_FLAG_KEY)
+                        && requeuePacket(&sp, avPacket)) {
+                    avcodec_send_packet(sp.codecContext, NULL);
+                    vsp->isRetuning = true;
+                    continue;
+                }
 
-        if ((averr = avcodec_send_packet(sp.codecContext, avPacket)) != 0) {
-            qDebug() <<  __PRETTY_FUNCTION__ << "failed to send packet," << averr << iav_err2str(averr);
-//            return averr;
-            continue;
-        }
+                // a frame at an exact position must not be skipped
+                applyVideoSkipLevel(vsp, specifyPos ? (int)SKIP_NONE : vsp->skipLevel.load());
+                if ((averr = avcodec_send_packet(sp.codecContext, avPacket)) != 0) {
+                    qDebug() <<  __PRETTY_FUNCTION__ << "failed to send packet," << averr << iav_err2str(averr);
+//                    return averr;
+                    continue;
+                }
 
-        AVFrame *pAVFrame = av_frame_alloc();
-        SPAVFrame spAVFrame(pAVFrame, freeAVFarme);
-        if ((averr = avcodec_receive_frame(sp.codecContext, pAVFrame)) != 0) {
-            if (averr != AVERROR(EAGAIN)) {
-                qDebug() <<  __PRETTY_FUNCTION__ << "failed to receive frame," << averr << iav_err2str(averr);
-                return averr;
+                if ((averr = avcodec_receive_frame(sp.codecContext, pAVFrame)) != 0) {
+                    if (averr != AVERROR(EAGAIN)) {
+                        qDebug() <<  __PRETTY_FUNCTION__ << "failed to receive frame," << averr << iav_err2str(averr);
+                        return averr;
+                    }
+                    continue;
+                }
             }
-            continue;
         }
 
 //        qDebug() <<  __PRETTY_FUNCTION__
@@ -1474,6 +2123,16 @@ int AVDecoderCore::getVideoNextFrame(int index, SPAVFrame &frame, bool specifyPo
         if (specifyPos && (pAVFrame->pts + pAVFrame->pkt_duration) * av_q2d(sp.stream->time_base) < pos) {
             continue;
         }
+        // frames decoded while skipping would make the decoder look faster than it is
+        if (!specifyPos && !specifyKeyFrame && m_videoDecodeThreads == 0 && vsp->appliedSkipLevel == SKIP_NONE) {
+            vsp->decodeTime += decodeTimer.nsecsElapsed();
+            if (++vsp->decodeFrames >= DECODE_TUNE_FRAMES) {
+                tuneVideoDecodeThreads(vsp);
+            }
+        }
+        if ((averr = scaleVideoFrame(vsp, spAVFrame)) < 0) {
+            qDebug() <<  __PRETTY_FUNCTION__ << "failed to scale frame," << averr << iav_err2str(averr);
+        }
         frame = spAVFrame;
         break;
 
@@ -1500,10 +2159,13 @@ void AVDecoderCore::getSubtitle(AVDecoderCore::SubtitleStreamParty *ssp)
     }
 
     int averr = 0;
+    QSharedPointer<AVPacket> spAVPacket = ssp->streamParty.packetPool->get();
+    if (spAVPacket.isNull()) {
+        return;
+    }
+    AVPacket *avPacket = spAVPacket.data();
     while (1) {
-        AVPacket *avPacket = new AVPacket;
-        QSharedPointer<AVPacket> spAVPacket(avPacket, deleteAVPacket);
-        av_init_packet(avPacket);
+        av_packet_unref(avPacket);
         if ((averr = av_read_frame(ssp->streamParty.formatContext, avPacket)) != 0) {
             if (averr == AVERROR_EOF) {
                 qDebug() <<  __PRETTY_FUNCTION__ << "decode end of file";
@@ -15,11 +15,20 @@ extern "C"
 
 #include <QtCore>
 
+#include "keyframeindex.h"
+#include "avobjectpool.h"
+#include "audioringbuffer.h"
+#include "iointerrupter.h"
+
 #ifndef TYPEDEF_SPAVFRAME
 #define TYPEDEF_SPAVFRAME
 typedef QSharedPointer<AVFrame> SPAVFrame;
 #endif
 
+// idle objects kept by the pools of each stream
+#define MAX_POOL_PACKETS    256
+#define MAX_POOL_FRAMES     32
+
 class AVDecoderCore
 {
 public:
@@ -35,6 +44,14 @@ public:
         SEEK_RIGHT_KEY,
     };
 
+    // how much of the video the decoder may leave out to keep up
+    enum SKIP_Level {
+        SKIP_NONE,
+        SKIP_LOOP_FILTER,       // no loop filter on non-reference frames
+        SKIP_NON_REF_FRAMES,    // drop non-reference frames, no loop filter at all
+        SKIP_NON_KEY_FRAMES,    // decode key frames only
+    };
+
 public:
     AVDecoderCore();
     ~AVDecoderCore();
@@ -45,6 +62,25 @@ public:
     QString getFile();
     void showInfo();
 
+    // make demuxer reads and seeks already running return AVERROR_EXIT,
+    // calls started afterwards are not affected
+    void interruptIO();
+
+    // probe limits used by load(), 0 keeps the libavformat defaults
+    void setProbeSize(int64_t size);
+    int64_t getProbeSize();
+    void setAnalyzeDuration(double duration);
+    double getAnalyzeDuration();
+
+    // decoder threads of the video streams enabled afterwards, 0 starts from
+    // the cores other players have left and keeps tuning the count from the
+    // measured decode time per frame
+    void setVideoDecodeThreads(int count);
+    int getVideoDecodeThreads();
+    // FF_THREAD_FRAME and/or FF_THREAD_SLICE
+    void setVideoDecodeThreadType(int type);
+    int getVideoDecodeThreadType();
+
     // audio interfaces
     bool hasAudioStream();
     int getAudioStreamCount();
@@ -80,7 +116,10 @@ public:
     int getAudioOutputBytesPerSecond(int index);
 
     bool seekAudio(int index, double pos);
-    int getAudioNextFrame(int index, QByteArray &data, double &pts, double &duration);
+    // decode into the buffer, which must use the output format of the stream
+    int getAudioNextFrame(int index, AudioRingBuffer *buffer);
+    // packets and frames allocated by the stream so far, flat during steady playback
+    int getAudioAllocCount(int index);
 
 
     // video interfaces
@@ -103,11 +142,22 @@ public:
 
     bool seekVideo(int index, double pos, SEEK_Type type = SEEK_LEFT_KEY);
     bool getVideoSeekPos(int index, double t, SEEK_POS_Type type, double &spos);
+    // available once the key frame index of the stream has been built
     bool getVideoKeyFramePosList(int index, QList<double> &posList);
 
     int getVideoNextFrame(int index, SPAVFrame &frame);
     int getVideoNextFrame(int index, SPAVFrame &frame, double pos);
     int getVideoNextKeyFrame(int index, SPAVFrame &frame);
+    int getVideoAllocCount(int index);
+    // threads the decoder of the stream is running with
+    int getVideoDecodeThreadCount(int index);
+    // may be called from any thread, the decoder picks it up with its next packet
+    void setVideoSkipLevel(int index, SKIP_Level level);
+    SKIP_Level getVideoSkipLevel(int index);
+    // size the video is shown at. The frames are halved as long as they stay
+    // at least that large, with the codec's lowres where it has one, by
+    // scaling on the decode thread otherwise. 0x0 keeps the full resolution.
+    void setVideoTargetSize(int index, int width, int height);
 
     double calculateVideoTimestamp(int index, long long t);
 
@@ -125,8 +175,31 @@ protected:
         AVCodecParameters *codecPar;
         AVCodecContext *codecContext;
 
+        // packets demuxed for this stream, guarded by m_demuxMtx
+        QList<AVPacket*> packetQueue;
+        int packetQueueSize;
+        // demuxer seek serial the codec state belongs to
+        int serial;
+        // packets read after a sibling stream moved the demuxer, given back
+        // to the queue if this stream then seeks to the same place
+        QList<AVPacket*> replayPackets;
+        bool replayable;
+        // video only, fed with every packet the demuxer reads for this stream
+        KeyFrameIndex *keyFrameIndex;
+        // interrupt generation the running call of this stream started in
+        int ioGeneration;
+        // decoder threads, 0 leaves the codec default
+        int threadCount;
+        int lowres;
+
+        QSharedPointer<AVPacketPool> packetPool;
+        QSharedPointer<AVFramePool> framePool;
+
         StreamParty()
             : streamIndex(-1), streamType(AVMEDIA_TYPE_UNKNOWN), formatContext(0), stream(0), codecPar(0), codecContext(0)
+            , packetQueueSize(0), serial(0), replayable(false), keyFrameIndex(0), ioGeneration(0)
+            , threadCount(0), lowres(0)
+            , packetPool(AVPacketPool::create(MAX_POOL_PACKETS)), framePool(AVFramePool::create(MAX_POOL_FRAMES))
         {}
     };
 
@@ -155,6 +228,12 @@ protected:
         int outputBytesPerFrame;
         int outputBytesPerSecond;
 
+        // kept across frames, rebuilt only when the decoded format changes
+        SwrContext *swrContext;
+        AVSampleFormat swrInputSampleFormat;
+        uint64_t swrInputChannelLayout;
+        int swrInputSampleRate;
+
         QMap<QString,QString> metadata;
 
         AudioStreamParty()
@@ -165,12 +244,13 @@ protected:
             , outputSampleFormat(AV_SAMPLE_FMT_NONE), outputSampleSize(0), outputSampleRate(0)
             , outputChannels(0), outputChannelLayout(0)
             , outputBytesPerSample(0), outputBytesPerFrame(0), outputBytesPerSecond(0)
+            , swrContext(0), swrInputSampleFormat(AV_SAMPLE_FMT_NONE), swrInputChannelLayout(0)
+            , swrInputSampleRate(0)
         {}
     };
 
     struct VideoStreamParty {
         StreamParty streamParty;
-        StreamParty streamParty2;   // for query
 
         double duration;
         int64_t bitrate;
@@ -178,11 +258,35 @@ protected:
         int width, height;
         AVPixelFormat format;
 
+        // decode time of the frames since the last tuning, in nanoseconds
+        qint64 decodeTime;
+        int decodeFrames;
+        // thread count the decoder is reopened with at the next key packet,
+        // after the frames held by the old one have been drained
+        int retuneThreadCount;
+        int retuneLowres;
+        bool isRetuning;
+
+        // set by setVideoTargetSize(), the frames are halved scaleShift times
+        // by the codec's lowres and what it cannot do by swsContext
+        QAtomicInt targetWidth, targetHeight;
+        int scaleShift;
+        SwsContext *swsContext;
+        // swscale cannot do the format, the frames go on as they are decoded
+        bool isScaleFailed;
+
+        // SKIP_Level asked for, and the one the codec context runs with
+        QAtomicInt skipLevel;
+        int appliedSkipLevel;
+
         QMap<QString,QString> metadata;
 
         VideoStreamParty()
             : duration(0.0), bitrate(0), frameRate(0.0)
             , width(0), height(0), format(AV_PIX_FMT_NONE)
+            , decodeTime(0), decodeFrames(0), retuneThreadCount(0), retuneLowres(0), isRetuning(false)
+            , targetWidth(0), targetHeight(0), scaleShift(0), swsContext(0), isScaleFailed(false)
+            , skipLevel(SKIP_NONE), appliedSkipLevel(SKIP_NONE)
         {}
     };
 
@@ -216,9 +320,22 @@ protected:
     };
 
 protected:
-    bool initStreamParty(StreamParty *sp, const QString &file);
+    bool initDemuxer();
+    void uninitDemuxer();
+
+    bool initStreamParty(StreamParty *sp);
+    bool openFormatContext(const QString &file, AVFormatContext **formatContext);
+    bool openStreamCodec(StreamParty *sp, AVFormatContext *formatContext);
+    AVCodecContext *openCodecContext(AVCodecParameters *codecPar, int threadCount, int lowres);
+    bool reopenStreamCodec(StreamParty *sp, int threadCount, int lowres);
     void uninitStreamParty(StreamParty *sp);
 
+    int readPacket(StreamParty *sp, QSharedPointer<AVPacket> &packet);
+    void pushPacket(StreamParty *sp, AVPacket *packet);
+    void clearPacketQueue(StreamParty *sp);
+    void clearReplayPackets(StreamParty *sp);
+    bool seekStreamParty(StreamParty *sp, double pos, int flags);
+
 //    double getAudioDuration(AudioStreamParty *asp);
 //    int getVideoBitrate(AudioStreamParty *asp);
 
@@ -247,7 +364,16 @@ protected:
 //    int getVideoHeight(VideoStreamParty *vsp);
 //    AVPixelFormat getVideoPixelFormat(VideoStreamParty *vsp);
 
+    int updateSwrContext(AudioStreamParty *asp, const AVFrame *frame);
+    int convertAudio(AudioStreamParty *asp, AudioRingBuffer *buffer, const uint8_t **in, int inCount);
+
     int getVideoNextFrame(int index, SPAVFrame &frame, bool specifyPos, double pos, bool specifyKeyFrame);
+    int getAutoThreadCount();
+    void tuneVideoDecodeThreads(VideoStreamParty *vsp);
+    void applyVideoSkipLevel(VideoStreamParty *vsp, int level);
+    void updateVideoScale(VideoStreamParty *vsp);
+    int scaleVideoFrame(VideoStreamParty *vsp, SPAVFrame &frame);
+    bool requeuePacket(StreamParty *sp, const AVPacket *packet);
 
     void getSubtitle(SubtitleStreamParty *ssp);
 
@@ -255,8 +381,21 @@ protected:
 
 protected:
     QString m_file;
+    int64_t m_probeSize;
+    double m_analyzeDuration;
+    int m_videoDecodeThreads;
+    int m_videoDecodeThreadType;
 
+    // probed by load() and kept as the demuxer shared by all enabled streams
     AVFormatContext *m_formatContext;
+    AVPacket m_demuxPacket;
+    QMap<int, StreamParty*> m_demuxStreamParties;
+    QMutex m_demuxMtx;
+    int m_demuxSerial;
+    double m_demuxSeekPos;
+    int m_demuxSeekFlags;
+    // armed with the generation of the stream calling into m_formatContext
+    IOInterrupter m_demuxInterrupter;
 
     QList<AudioStreamParty*> m_audioStreamParties;
     QList<VideoStreamParty*> m_videoStreamParties;
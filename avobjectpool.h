@@ -0,0 +1,156 @@
+#ifndef AVOBJECTPOOL_H
+#define AVOBJECTPOOL_H
+
+extern "C"
+{
+#include <libavcodec/avcodec.h>
+#include <libavutil/frame.h>
+}
+
+#include <QtCore>
+
+// Keeps released AVPacket/AVFrame structs for reuse, so a decode loop in its
+// steady state does not allocate them. Objects handed out by get()/wrap()
+// come back here when the last reference is dropped, or are freed if the
+// pool is already gone by then.
+template <typename T>
+class AVObjectPool
+{
+public:
+    static QSharedPointer<AVObjectPool<T> > create(int maxCount)
+    {
+        QSharedPointer<AVObjectPool<T> > pool(new AVObjectPool<T>(maxCount));
+        pool->m_self = pool;
+        return pool;
+    }
+
+    ~AVObjectPool()
+    {
+        foreach (T *obj, m_objects) {
+            freeObject(obj);
+        }
+    }
+
+    // the caller owns the object until it is given to recycle() or wrap()
+    T *take()
+    {
+        m_mtx.lock();
+        if (!m_objects.isEmpty()) {
+            T *obj = m_objects.takeLast();
+            m_mtx.unlock();
+            return obj;
+        }
+        m_mtx.unlock();
+
+        T *obj = allocObject();
+        if (obj != 0) {
+            m_allocCount.fetchAndAddOrdered(1);
+        }
+        return obj;
+    }
+
+    void recycle(T *obj)
+    {
+        if (obj == 0) {
+            return;
+        }
+        unrefObject(obj);
+
+        m_mtx.lock();
+        if (m_objects.count() < m_maxCount) {
+            m_objects.append(obj);
+            obj = 0;
+        }
+        m_mtx.unlock();
+
+        if (obj != 0) {
+            freeObject(obj);
+        }
+    }
+
+    QSharedPointer<T> wrap(T *obj)
+    {
+        if (obj == 0) {
+            return QSharedPointer<T>();
+        }
+        QWeakPointer<AVObjectPool<T> > self = m_self;
+        return QSharedPointer<T>(obj, [self](T *p) {
+            QSharedPointer<AVObjectPool<T> > pool = self.toStrongRef();
+            if (pool) {
+                pool->recycle(p);
+            }
+            else {
+                freeObject(p);
+            }
+        });
+    }
+
+    QSharedPointer<T> get()
+    {
+        return wrap(take());
+    }
+
+    // how many objects were ever allocated, stays flat once the pool is warm
+    int getAllocCount()
+    {
+        return m_allocCount.load();
+    }
+
+protected:
+    explicit AVObjectPool(int maxCount)
+        : m_maxCount(maxCount)
+        , m_allocCount(0)
+    {}
+
+    static T *allocObject();
+    static void unrefObject(T *obj);
+    static void freeObject(T *obj);
+
+private:
+    QWeakPointer<AVObjectPool<T> > m_self;
+    QList<T*> m_objects;
+    int m_maxCount;
+    QAtomicInt m_allocCount;
+    QMutex m_mtx;
+};
+
+template <>
+inline AVPacket *AVObjectPool<AVPacket>::allocObject()
+{
+    return av_packet_alloc();
+}
+
+template <>
+inline void AVObjectPool<AVPacket>::unrefObject(AVPacket *obj)
+{
+    av_packet_unref(obj);
+}
+
+template <>
+inline void AVObjectPool<AVPacket>::freeObject(AVPacket *obj)
+{
+    av_packet_free(&obj);
+}
+
+template <>
+inline AVFrame *AVObjectPool<AVFrame>::allocObject()
+{
+    return av_frame_alloc();
+}
+
+template <>
+inline void AVObjectPool<AVFrame>::unrefObject(AVFrame *obj)
+{
+    av_frame_unref(obj);
+}
+
+template <>
+inline void AVObjectPool<AVFrame>::freeObject(AVFrame *obj)
+{
+    av_frame_free(&obj);
+}
+
+typedef AVObjectPool<AVPacket> AVPacketPool;
+typedef AVObjectPool<AVFrame> AVFramePool;
+
+#endif // AVOBJECTPOOL_H
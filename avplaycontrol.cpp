@@ -1,5 +1,12 @@
 #include "avplaycontrol.h"
-#include "audioplayer_directsound.h"
+#include "audioplayerfactory.h"
+
+// waiting less than this for a frame is not worth a timer round
+#define FRAME_WAIT_THRESHOLD    0.001
+// a frame handed over this much after its pts counts as late
+#define FRAME_SYNC_THRESHOLD    0.010
+// when neither the frame nor the stream tells
+#define DEFAULT_FRAME_DURATION  0.04
 
 AVPlayControl::AVPlayControl()
     : m_decoderCore(0)
@@ -7,8 +14,12 @@ AVPlayControl::AVPlayControl()
     , m_enabledVideoStreamIndex(-1)
     , m_audioPlayer(0)
     , m_videoDecoderBuffer(0)
+    , m_audioSink(AudioPlayerFactory::getDefaultSpec())
     , m_isPlaying(false)
     , m_position(0.0)
+    , m_clockMaster(AVClock::MASTER_AUDIO)
+    , m_clockSerial(-1)
+    , m_seekSerial(0)
 {
 
 }
@@ -20,9 +31,8 @@ AVPlayControl::~AVPlayControl()
 
 void AVPlayControl::init()
 {
-    m_videoShowTimer.setInterval(40);
-    connect(&m_videoShowTimer, SIGNAL(timeout()),
-            this, SLOT(onVideoShowTimerTimeout()));
+    connect(&m_frameTimer, SIGNAL(timeout()),
+            this, SLOT(onFrameTimerTimeout()));
 }
 
 bool AVPlayControl::load(const QString &file)
@@ -57,8 +67,8 @@ bool AVPlayControl::load(const QString &file)
             return false;
         }
         m_enabledAudioStreamIndex = index;
-        m_audioPlayer = new AudioPlayer_DirectSound(m_decoderCore, m_enabledAudioStreamIndex);
-        if (!m_audioPlayer->isAvailable()) {
+        m_audioPlayer = AudioPlayerFactory::create(m_audioSink, m_decoderCore, m_enabledAudioStreamIndex);
+        if (m_audioPlayer == 0 || !m_audioPlayer->isAvailable()) {
             unload();
             return false;
         }
@@ -75,6 +85,7 @@ bool AVPlayControl::load(const QString &file)
             return false;
         }
         m_enabledVideoStreamIndex = index;
+        m_decoderCore->setVideoTargetSize(index, m_videoViewportSize.width(), m_videoViewportSize.height());
         m_videoDecoderBuffer = new VideoDecoderBuffer(m_decoderCore, m_enabledVideoStreamIndex);
         if (!m_videoDecoderBuffer->isAvailable()) {
             unload();
@@ -85,6 +96,12 @@ bool AVPlayControl::load(const QString &file)
     }
 
     setFile(file);
+
+    m_clock.pause();
+    m_clock.set(0.0);
+    m_clockSerial = -1;
+    m_frameStats = FrameStats();
+    updateClockMaster();
     return true;
 }
 
@@ -94,6 +111,11 @@ void AVPlayControl::unload()
         return;
     }
 
+    // the decode threads are joined below, do not wait for their I/O
+    if (m_decoderCore != 0) {
+        m_decoderCore->interruptIO();
+    }
+
     if (m_audioPlayer != 0) {
 //        m_audioPlayer->deleteLater();
         delete m_audioPlayer;
@@ -113,7 +135,10 @@ void AVPlayControl::unload()
         m_decoderCore = 0;
     }
 
-    m_videoShowTimer.stop();
+    m_frameTimer.stop();
+    m_clock.pause();
+    m_clockSerial = -1;
+    m_presenter.flush();
 
     setFile(QString());
     setPlaybackState(false);
@@ -185,8 +210,8 @@ void AVPlayControl::changeAudioStream(int index)
     if (!m_decoderCore->enableAudioStream(index)) {
         return;
     }
-    AudioPlayerBase *player = new AudioPlayer_DirectSound(m_decoderCore, index);
-    if (!player->isAvailable()) {
+    AudioPlayerBase *player = AudioPlayerFactory::create(m_audioSink, m_decoderCore, index);
+    if (player == 0 || !player->isAvailable()) {
         delete player;
         m_decoderCore->disableAudioStream(index);
         return;
@@ -210,6 +235,7 @@ void AVPlayControl::changeAudioStream(int index)
     m_decoderCore->disableAudioStream(m_enabledAudioStreamIndex);
     m_enabledAudioStreamIndex = index;
     m_audioPlayer = player;
+    updateClockMaster();
 }
 
 void AVPlayControl::changeAudioStream(const QString &title)
@@ -225,6 +251,19 @@ void AVPlayControl::changeAudioStream(const QString &title)
     }
 }
 
+void AVPlayControl::setAudioSink(const QString &spec)
+{
+    if (!AudioPlayerFactory::hasPlayer(spec)) {
+        return;
+    }
+    m_audioSink = spec;
+}
+
+QString AVPlayControl::getAudioSink()
+{
+    return m_audioSink;
+}
+
 bool AVPlayControl::isVideoAvailable()
 {
     if (!isLoaded()) {
@@ -247,14 +286,19 @@ void AVPlayControl::play()
 
     if (isAudioAvailable()) {
         m_audioPlayer->play();
-        return;
+        // the clock starts with the audio output
+        if (m_clock.getMasterType() == AVClock::MASTER_AUDIO) {
+            return;
+        }
     }
 
     if (isVideoAvailable()) {
         if (m_videoDecoderBuffer->isDecodeEnd()) {
             m_videoDecoderBuffer->resetDecoder();
+            m_clockSerial = -1;
         }
-        m_videoShowTimer.start();
+        m_clock.resume();
+        presentVideo();
     }
 
     checkPlaybackState();
@@ -273,9 +317,10 @@ void AVPlayControl::pause()
         m_audioPlayer->stop();
     }
 
-    if (isVideoAvailable()) {
-        m_videoShowTimer.stop();
+    if (m_clock.getMasterType() != AVClock::MASTER_AUDIO) {
+        m_clock.pause();
     }
+    m_frameTimer.stop();
 
     checkPlaybackState();
 }
@@ -289,7 +334,7 @@ bool AVPlayControl::isPlaying()
         return m_audioPlayer->isPlaying();
     }
     if (isVideoAvailable()) {
-        return m_videoShowTimer.isActive();
+        return !m_clock.isPaused();
     }
     return false;
 }
@@ -327,15 +372,20 @@ void AVPlayControl::seek(double pos)
     if (pos > getDuration()) {
         return;
     }
+    m_seekTime.start();
     double spos;
     if (!getSeekPos(pos, spos)) {
         return;
     }
+    // a seek still reading from slow storage is useless now
+    m_decoderCore->interruptIO();
     if (isAudioAvailable()) {
         m_audioPlayer->seek(spos);
     }
     if (isVideoAvailable()) {
+        m_presenter.flush();
         m_videoDecoderBuffer->seek(spos);
+        m_seekSerial = m_videoDecoderBuffer->getSeekSerial();
     }
 }
 
@@ -393,6 +443,48 @@ int AVPlayControl::getVideoHeight()
     return m_decoderCore->getVideoHeight(m_enabledVideoStreamIndex);
 }
 
+void AVPlayControl::setVideoViewportSize(const QSize &size)
+{
+    if (size == m_videoViewportSize) {
+        return;
+    }
+    m_videoViewportSize = size;
+    if (!isLoaded()) {
+        return;
+    }
+    if (!isVideoAvailable()) {
+        return;
+    }
+    m_decoderCore->setVideoTargetSize(m_enabledVideoStreamIndex, size.width(), size.height());
+}
+
+void AVPlayControl::setClockMaster(AVClock::MASTER_Type type)
+{
+    if (type == m_clockMaster) {
+        return;
+    }
+    m_clockMaster = type;
+    if (!isLoaded()) {
+        return;
+    }
+    updateClockMaster();
+}
+
+AVClock::MASTER_Type AVPlayControl::getClockMaster()
+{
+    return m_clockMaster;
+}
+
+AVPlayControl::FrameStats AVPlayControl::getFrameStats()
+{
+    return m_frameStats;
+}
+
+VideoPresenter *AVPlayControl::getVideoPresenter()
+{
+    return &m_presenter;
+}
+
 bool AVPlayControl::hasCover()
 {
     if (!isLoaded()) {
@@ -417,35 +509,12 @@ bool AVPlayControl::getCover(int index, SPAVFrame &frame)
     return m_decoderCore->getCover(index, frame);
 }
 
-void AVPlayControl::onVideoShowTimerTimeout()
+void AVPlayControl::onFrameTimerTimeout()
 {
     if (!isLoaded()) {
-        m_videoShowTimer.stop();
-        checkPlaybackState();
-        return;
-    }
-
-    if (!isVideoAvailable()) {
-        m_videoShowTimer.stop();
-        checkPlaybackState();
         return;
     }
-
-    while (1) {
-        if (!m_videoDecoderBuffer->hasBufferedData()) {
-            if (m_videoDecoderBuffer->isDecodeEnd()) {
-                m_videoShowTimer.stop();
-                checkPlaybackState();
-            }
-            return;
-        }
-        VideoDecoderBuffer::VideoData vd = m_videoDecoderBuffer->popBufferedData();
-        if (vd.time < 0 || vd.frame.isNull()) {
-            continue;
-        }
-        emit videoFrameUpdated(vd.frame);
-        setPosition(vd.time);
-    }
+    presentVideo(true);
 }
 
 void AVPlayControl::onAudioPlayerPlaybackStateChanged(bool isPlaying)
@@ -453,6 +522,16 @@ void AVPlayControl::onAudioPlayerPlaybackStateChanged(bool isPlaying)
     if (!isLoaded()) {
         return;
     }
+    if (m_clock.getMasterType() == AVClock::MASTER_AUDIO) {
+        if (isPlaying) {
+            m_clock.resume();
+            presentVideo();
+        }
+        else {
+            m_clock.pause();
+            m_frameTimer.stop();
+        }
+    }
     checkPlaybackState();
 }
 
@@ -461,9 +540,6 @@ void AVPlayControl::onAudioPlayerPositionChanged(double position)
     if (!isLoaded()) {
         return;
     }
-    if (isVideoAvailable()) {
-        syncVideo2Audio(position);
-    }
     setPosition(position);
 }
 
@@ -476,14 +552,14 @@ void AVPlayControl::onVideoDecoderBuffered()
         return;
     }
 
-    if (isAudioAvailable()) {
-        if (!m_audioPlayer->isPlaying()) {
-            emit videoFrameUpdated(m_videoDecoderBuffer->getBufferedData().frame);
-        }
-        else {
-            syncVideo2Audio(m_audioPlayer->getPosition());
+    if (m_clock.isPaused()) {
+        if (isAudioAvailable()) {
+            showVideoFrame(m_videoDecoderBuffer->getBufferedData());
         }
     }
+    else if (!m_frameTimer.isActive()) {
+        presentVideo();
+    }
 }
 
 void AVPlayControl::setFile(const QString &file)
@@ -501,6 +577,11 @@ void AVPlayControl::setPlaybackState(bool isPlaying)
         return;
     }
     m_isPlaying = isPlaying;
+    if (!isPlaying && m_frameStats.presented > 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "frames presented:" << m_frameStats.presented
+                 << "late:" << m_frameStats.late << "early:" << m_frameStats.early
+                 << "dropped:" << m_frameStats.dropped;
+    }
     emit playbackStateChanged(isPlaying);
 }
 
@@ -513,70 +594,134 @@ void AVPlayControl::setPosition(double position)
     emit positionChanged(position);
 }
 
-void AVPlayControl::updateVideo()
+void AVPlayControl::updateClockMaster()
 {
-    if (!isVideoAvailable()) {
-        return;
+    AVClock::MASTER_Type type = m_clockMaster;
+    if (type == AVClock::MASTER_AUDIO && !isAudioAvailable()) {
+        type = AVClock::MASTER_EXTERNAL;
     }
-    if (!m_videoDecoderBuffer->hasBufferedData()) {
+    if (type == m_clock.getMasterType()) {
         return;
     }
 
-    VideoDecoderBuffer::VideoData vd = m_videoDecoderBuffer->popBufferedData();
-    if (vd.time < 0 || vd.frame.isNull()) {
-        return;
-    }
-    emit videoFrameUpdated(vd.frame);
-
-    if (!isAudioAvailable()) {
-        setPosition(vd.time);
+    // continue from where the old master was
+    m_clock.set(m_clock.get());
+    m_clock.setMasterType(type);
+    // whatever the master, the audio output plays or not for the whole file
+    if (isAudioAvailable()) {
+        if (m_audioPlayer->isPlaying()) {
+            m_clock.resume();
+        }
+        else {
+            m_clock.pause();
+        }
     }
 }
 
-void AVPlayControl::syncVideo2Audio(double postion)
+void AVPlayControl::presentVideo(bool isDeadline)
 {
-    if (!isLoaded()) {
+    if (!isVideoAvailable()) {
         return;
     }
-    if (!isVideoAvailable()) {
+    if (m_clock.isPaused()) {
+        m_frameTimer.stop();
         return;
     }
 
-    VideoDecoderBuffer::VideoData vd;
+    if (m_clock.getMasterType() == AVClock::MASTER_AUDIO) {
+        // latency compensated by the audio output, the deadline of the frame
+        // waited for follows it on the next wakeup
+        m_clock.set(m_audioPlayer->getClock());
+    }
+
     while (1) {
         if (!m_videoDecoderBuffer->hasBufferedData()) {
+            // buffered() brings us back
+            m_frameTimer.stop();
+            if (m_videoDecoderBuffer->isDecodeEnd() && !isAudioAvailable()) {
+                m_clock.pause();
+                checkPlaybackState();
+            }
             return;
         }
-        vd = m_videoDecoderBuffer->getBufferedData();
-        if (vd.time < 0 || vd.frame.isNull()) {
+        VideoDecoderBuffer::VideoData vd = m_videoDecoderBuffer->getBufferedData();
+        // decoded before the last seek
+        if (vd.time < 0 || vd.frame.isNull() || vd.serial != m_videoDecoderBuffer->getSeekSerial()) {
             m_videoDecoderBuffer->popBufferedData();
             continue;
         }
 
-        double duration = 0.04, frameRate = 0.0;
-        if (vd.duration > 0.0) {
-            duration =  vd.duration;
+        if (vd.serial != m_clockSerial) {
+            m_clockSerial = vd.serial;
+            if (m_clock.getMasterType() != AVClock::MASTER_AUDIO) {
+                m_clock.set(vd.time);
+            }
         }
-        else if ((frameRate = m_decoderCore->getVideoFrameRate(m_enabledVideoStreamIndex)) > 0.0) {
-            duration = 1 / frameRate;
+
+        // the presenter picks a frame at the vsync before the one it goes to
+        double ahead = 2.0 / m_presenter.getRefreshRate();
+        double delay = vd.time - m_clock.get();
+        if (delay > ahead + FRAME_WAIT_THRESHOLD) {
+            if (isDeadline) {
+                // the clock fell behind the system time since the wait began
+                ++m_frameStats.early;
+            }
+            m_frameTimer.start(m_clock.getTimeOf(vd.time - ahead));
+            return;
         }
 
-        if (vd.time + duration < postion) {
-//            qDebug() << __PRETTY_FUNCTION__
-//                     << "skip video buffered data"
-//                     << "vd time:" << vd.time
-//                     << "vd duration:" << vd.duration
-//                     << "m_position:" << m_position
-//                     << "duration:" << duration
-//                     << "audio pos:" << postion;
+        double duration = getFrameDuration(vd);
+        if (-delay > duration && m_clock.getMasterType() != AVClock::MASTER_VIDEO) {
+            m_videoDecoderBuffer->reportLateness(-delay - duration);
             m_videoDecoderBuffer->popBufferedData();
+            ++m_frameStats.dropped;
             continue;
         }
 
-        if (vd.time <= postion && postion <= vd.time + duration) {
-            emit videoFrameUpdated(vd.frame);
+        m_videoDecoderBuffer->popBufferedData();
+        m_videoDecoderBuffer->reportLateness(0.0);
+        ++m_frameStats.presented;
+        if (-delay > FRAME_SYNC_THRESHOLD) {
+            ++m_frameStats.late;
+        }
+        if (m_clock.getMasterType() == AVClock::MASTER_VIDEO && delay < 0.0) {
+            // a late frame moves the video timeline instead of being dropped
+            m_clock.set(vd.time);
+        }
+
+        reportSeekLatency(vd);
+        m_presenter.push(vd.frame, m_clock.getTimeOf(vd.time), (qint64)(duration * 1000000.0));
+        if (!isAudioAvailable()) {
+            setPosition(vd.time);
         }
-        break;
+        // the wait for the next one has not begun yet
+        isDeadline = false;
+    }
+}
+
+double AVPlayControl::getFrameDuration(const VideoDecoderBuffer::VideoData &vd)
+{
+    if (vd.duration > 0.0) {
+        return vd.duration;
+    }
+    double frameRate = m_decoderCore->getVideoFrameRate(m_enabledVideoStreamIndex);
+    if (frameRate > 0.0) {
+        return 1 / frameRate;
+    }
+    return DEFAULT_FRAME_DURATION;
+}
+
+void AVPlayControl::showVideoFrame(const VideoDecoderBuffer::VideoData &vd)
+{
+    reportSeekLatency(vd);
+    emit videoFrameUpdated(vd.frame);
+}
+
+void AVPlayControl::reportSeekLatency(const VideoDecoderBuffer::VideoData &vd)
+{
+    if (m_seekSerial != 0 && vd.serial == m_seekSerial) {
+        qDebug() << __PRETTY_FUNCTION__ << "seek latency" << m_seekTime.elapsed() << "ms";
+        m_seekSerial = 0;
     }
 }
 
@@ -595,7 +740,7 @@ void AVPlayControl::checkPlaybackState()
     }
 
     if (isVideoAvailable()) {
-        if (m_videoShowTimer.isActive()) {
+        if (!m_clock.isPaused()) {
             setPlaybackState(true);
             return;
         }
@@ -6,6 +6,9 @@
 
 #include "audioplayerbase.h"
 #include "videodecoderbuffer.h"
+#include "avclock.h"
+#include "deadlinetimer.h"
+#include "videopresenter.h"
 
 class AVPlayControl : public QObject
 {
@@ -15,6 +18,16 @@ public:
         Stopped, Playing, Paused,
     };
 
+    // how the shown frames kept to their pts since the file was loaded
+    struct FrameStats {
+        int presented;
+        int late;               // handed to the presenter after their pts
+        int early;              // their wait ended before the clock reached them
+        int dropped;            // their successor was due already
+
+        FrameStats() : presented(0), late(0), early(0), dropped(0) {}
+    };
+
 public:
     AVPlayControl();
     ~AVPlayControl();
@@ -33,6 +46,9 @@ public:
     int getCurrentAudioStreamIndex();
     void changeAudioStream(int index);
     void changeAudioStream(const QString &title);
+    // see AudioPlayerFactory, taken by the next load() or stream change
+    void setAudioSink(const QString &spec);
+    QString getAudioSink();
 
     bool isVideoAvailable();
 
@@ -48,6 +64,15 @@ public:
 
     int getVideoWidth();
     int getVideoHeight();
+    // the video is decoded at a lower resolution while it is shown much smaller
+    void setVideoViewportSize(const QSize &size);
+
+    // MASTER_AUDIO falls back to MASTER_EXTERNAL for files without audio
+    void setClockMaster(AVClock::MASTER_Type type);
+    AVClock::MASTER_Type getClockMaster();
+    FrameStats getFrameStats();
+    // the frames played go out through its frameReady(), paced to the vsyncs
+    VideoPresenter *getVideoPresenter();
 
     bool hasCover();
     int getCoverCount();
@@ -60,7 +85,7 @@ signals:
     void positionChanged(double pos);
 
 protected slots:
-    void onVideoShowTimerTimeout();
+    void onFrameTimerTimeout();
 
     void onAudioPlayerPlaybackStateChanged(bool isPlaying);
     void onAudioPlayerPositionChanged(double getPosition);
@@ -72,8 +97,14 @@ protected:
     void setPlaybackState(bool isPlaying);
     void setPosition(double position);
 
-    void updateVideo();
-    void syncVideo2Audio(double postion);
+    void updateClockMaster();
+    // hands the buffered frames due soon to the presenter and waits for the
+    // next one, isDeadline if the wait for the first of them is over
+    void presentVideo(bool isDeadline = false);
+    double getFrameDuration(const VideoDecoderBuffer::VideoData &vd);
+    // right away, not paced, for the frames shown while paused
+    void showVideoFrame(const VideoDecoderBuffer::VideoData &vd);
+    void reportSeekLatency(const VideoDecoderBuffer::VideoData &vd);
 
     void checkPlaybackState();
 
@@ -83,10 +114,23 @@ private:
     int m_enabledAudioStreamIndex, m_enabledVideoStreamIndex;
     AudioPlayerBase *m_audioPlayer;
     VideoDecoderBuffer *m_videoDecoderBuffer;
+    QString m_audioSink;
     bool m_isPlaying;
     double m_position;
 
-    QTimer m_videoShowTimer;
+    AVClock::MASTER_Type m_clockMaster;
+    AVClock m_clock;
+    // serial of the frames the clock was started on, the video master and
+    // the external clock restart at the first frame after a seek
+    int m_clockSerial;
+    DeadlineTimer m_frameTimer;
+    FrameStats m_frameStats;
+    VideoPresenter m_presenter;
+    QSize m_videoViewportSize;
+
+    // from the seek request to the first frame decoded after it being shown
+    QElapsedTimer m_seekTime;
+    int m_seekSerial;
 
 };
 
@@ -0,0 +1,53 @@
+#include "deadlinetimer.h"
+#include "avclock.h"
+
+DeadlineTimer::DeadlineTimer(QObject *parent)
+    : QObject(parent)
+    , m_timer(this)
+    , m_deadline(0)
+{
+    m_timer.setSingleShot(true);
+    m_timer.setTimerType(Qt::PreciseTimer);
+    connect(&m_timer, SIGNAL(timeout()), this, SLOT(onTimerOut()));
+}
+
+void DeadlineTimer::start(qint64 deadline)
+{
+    m_deadline = deadline;
+    arm();
+}
+
+void DeadlineTimer::stop()
+{
+    m_timer.stop();
+}
+
+bool DeadlineTimer::isActive()
+{
+    return m_timer.isActive();
+}
+
+qint64 DeadlineTimer::getDeadline()
+{
+    return m_deadline;
+}
+
+void DeadlineTimer::onTimerOut()
+{
+    if (AVClock::getSystemTime() < m_deadline) {
+        arm();
+        return;
+    }
+    emit timeout();
+}
+
+void DeadlineTimer::arm()
+{
+    qint64 remaining = m_deadline - AVClock::getSystemTime();
+    if (remaining <= 0) {
+        m_timer.start(0);
+        return;
+    }
+    // rounded up, the timer has millisecond granularity
+    m_timer.start((int)((remaining + 999) / 1000));
+}
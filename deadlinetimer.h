@@ -0,0 +1,36 @@
+#ifndef DEADLINETIMER_H
+#define DEADLINETIMER_H
+
+#include <QtCore>
+
+// Single shot timer firing once AVClock::getSystemTime() reaches a deadline.
+// The wait is taken from the deadline again on every wakeup, so it never fires
+// early and neither the timer granularity nor a late wakeup add up over time.
+class DeadlineTimer : public QObject
+{
+    Q_OBJECT
+public:
+    explicit DeadlineTimer(QObject *parent = 0);
+
+    // in microseconds of AVClock::getSystemTime(), a passed one fires right away
+    void start(qint64 deadline);
+    void stop();
+    bool isActive();
+    qint64 getDeadline();
+
+signals:
+    void timeout();
+
+private slots:
+    void onTimerOut();
+
+private:
+    void arm();
+
+private:
+    // a child, so it follows moveToThread()
+    QTimer m_timer;
+    qint64 m_deadline;
+};
+
+#endif // DEADLINETIMER_H
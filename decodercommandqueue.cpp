@@ -0,0 +1,121 @@
+#include "decodercommandqueue.h"
+#include "smartmutex.h"
+
+DecoderCommandQueue::DecoderCommandQueue()
+    : m_decodePending(0)
+    , m_cancelSerial(1)
+{
+}
+
+int DecoderCommandQueue::push(const DecoderCommand &cmd)
+{
+    if (cmd.type == DecoderCommand::DECODE && !cmd.hasPos && m_decodePending.load() != 0) {
+        return 0;
+    }
+
+    SmartMutex mtx(&m_mtx);
+    DecoderCommand c = cmd;
+
+    switch (c.type) {
+    case DecoderCommand::DECODE:
+        for (QList<DecoderCommand>::iterator it = m_commands.begin(); it != m_commands.end(); ) {
+            if (it->type == DecoderCommand::DECODE) {
+                it = m_commands.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        c.token = m_cancelSerial.load();
+        m_decodePending.store(1);
+        break;
+
+    case DecoderCommand::SEEK:
+        for (QList<DecoderCommand>::iterator it = m_commands.begin(); it != m_commands.end(); ) {
+            if (it->type == DecoderCommand::DECODE
+                    || (it->type == DecoderCommand::SEEK && it->stream == c.stream)) {
+                it = m_commands.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+        c.token = m_cancelSerial.fetchAndAddOrdered(1) + 1;
+        m_decodePending.store(0);
+        break;
+
+    case DecoderCommand::QUIT:
+        m_commands.clear();
+        c.token = m_cancelSerial.fetchAndAddOrdered(1) + 1;
+        m_decodePending.store(0);
+        break;
+
+    default:
+        return 0;
+    }
+
+    m_commands.append(c);
+    m_cond.wakeAll();
+    return c.token;
+}
+
+DecoderCommand DecoderCommandQueue::take()
+{
+    SmartMutex mtx(&m_mtx);
+    while (m_commands.isEmpty()) {
+        m_cond.wait(&m_mtx);
+    }
+
+    int index = 0;
+    for (int i = 1; i < m_commands.count(); ++i) {
+        if (getPriority(m_commands[i].type) > getPriority(m_commands[index].type)) {
+            index = i;
+        }
+    }
+    DecoderCommand cmd = m_commands.takeAt(index);
+    if (cmd.type == DecoderCommand::DECODE) {
+        m_decodePending.store(0);
+    }
+    return cmd;
+}
+
+void DecoderCommandQueue::clear()
+{
+    SmartMutex mtx(&m_mtx);
+    m_commands.clear();
+    m_decodePending.store(0);
+}
+
+void DecoderCommandQueue::removeDecodeCommands()
+{
+    SmartMutex mtx(&m_mtx);
+    for (QList<DecoderCommand>::iterator it = m_commands.begin(); it != m_commands.end(); ) {
+        if (it->type == DecoderCommand::DECODE) {
+            it = m_commands.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+    m_decodePending.store(0);
+}
+
+bool DecoderCommandQueue::isCanceled(int token)
+{
+    if (token == 0) {
+        return false;
+    }
+    return token != m_cancelSerial.load();
+}
+
+int DecoderCommandQueue::getPriority(DecoderCommand::Type type)
+{
+    switch (type) {
+    case DecoderCommand::QUIT:
+        return 2;
+    case DecoderCommand::SEEK:
+        return 1;
+    default:
+        return 0;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef DECODERCOMMANDQUEUE_H
+#define DECODERCOMMANDQUEUE_H
+
+#include <QtCore>
+
+struct DecoderCommand
+{
+    enum Type {
+        DECODE,
+        SEEK,
+        QUIT,
+    };
+
+    Type type;
+    int stream;         // seeks are only coalesced within the same stream
+    double pos;
+    bool hasPos;
+    int seekType;
+    int token;          // set by the queue, see DecoderCommandQueue::isCanceled()
+
+    DecoderCommand(Type _type = DECODE)
+        : type(_type), stream(-1), pos(0.0), hasPos(false), seekType(0), token(0)
+    {}
+
+    static DecoderCommand decode()
+    {
+        return DecoderCommand(DECODE);
+    }
+
+    static DecoderCommand decode(double pos)
+    {
+        DecoderCommand cmd(DECODE);
+        cmd.pos = pos;
+        cmd.hasPos = true;
+        return cmd;
+    }
+
+    static DecoderCommand seek(int stream, double pos, int seekType = 0)
+    {
+        DecoderCommand cmd(SEEK);
+        cmd.stream = stream;
+        cmd.pos = pos;
+        cmd.hasPos = true;
+        cmd.seekType = seekType;
+        return cmd;
+    }
+
+    static DecoderCommand quit()
+    {
+        return DecoderCommand(QUIT);
+    }
+};
+
+// Commands for a decode thread. Instead of piling up, new commands replace the
+// pending ones they make pointless:
+//   DECODE is dropped if a DECODE is already pending,
+//   SEEK replaces the pending SEEK of the same stream and every pending DECODE,
+//   QUIT replaces everything.
+// take() returns QUIT before SEEK before DECODE.
+//
+// Every SEEK and QUIT also cancels the commands taken before it, a handler
+// running a long command polls isCanceled() with the command's token. The
+// token 0 is never handed out and never canceled.
+class DecoderCommandQueue
+{
+public:
+    DecoderCommandQueue();
+
+    // returns the token given to the command, 0 if it was dropped
+    int push(const DecoderCommand &cmd);
+    // blocks until there is a command
+    DecoderCommand take();
+    void clear();
+    void removeDecodeCommands();
+
+    bool isCanceled(int token);
+
+protected:
+    static int getPriority(DecoderCommand::Type type);
+
+private:
+    QList<DecoderCommand> m_commands;
+    QMutex m_mtx;
+    QWaitCondition m_cond;
+
+    // lets the consumers of a buffer ask for more data after every read
+    // without taking the mutex while a DECODE is already pending
+    QAtomicInt m_decodePending;
+    QAtomicInt m_cancelSerial;
+};
+
+#endif // DECODERCOMMANDQUEUE_H
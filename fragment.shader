@@ -5,30 +5,136 @@ uniform sampler2D tex0;
 uniform sampler2D tex1;
 uniform sampler2D tex2;
 
-uniform int tex_type; // 0: ycbcr, 1: rgb
+uniform int tex_type; // 0: ycbcr, 1: rgb, 2: y + cbcr, 3: y + crcb, 4: planar rgb, 5: gray
+uniform float sample_scale; // for samples not using all bits of their texel
+
+// set from the colorspace and range of the frame, the range scaling is in the matrix
+uniform mat3 color_matrix;
+uniform vec3 color_offset;
+
+uniform int transfer;       // 0: sdr, 1: pq, 2: hlg
+uniform int tone_mapping;   // 0: none, 1: clip, 2: bt.2390
+uniform float src_peak;     // luminances in nits, *_pq the same through the pq inverse eotf
+uniform float src_peak_pq;
+uniform float dst_peak;
+uniform float dst_peak_pq;
+uniform mat3 gamut_matrix;  // linear source primaries to bt.709
+
+const float PQ_M1 = 0.1593017578125;
+const float PQ_M2 = 78.84375;
+const float PQ_C1 = 0.8359375;
+const float PQ_C2 = 18.8515625;
+const float PQ_C3 = 18.6875;
+
+vec3 yuv2rgb(vec3 yuv)
+{
+    return color_matrix * (yuv - color_offset);
+}
+
+// luminance in parts of 10000 nits
+vec3 pq_eotf(vec3 e)
+{
+    vec3 p = pow(max(e, 0.0), vec3(1.0 / PQ_M2));
+    return pow(max(p - PQ_C1, 0.0) / (PQ_C2 - PQ_C3 * p), vec3(1.0 / PQ_M1));
+}
+
+float pq_inverse_eotf(float y)
+{
+    float p = pow(max(y, 0.0), PQ_M1);
+    return pow((PQ_C1 + PQ_C2 * p) / (1.0 + PQ_C3 * p), PQ_M2);
+}
+
+// scene linear, 0..1
+vec3 hlg_inverse_oetf(vec3 e)
+{
+    const float a = 0.17883277;
+    const float b = 0.28466892;
+    const float c = 0.55991073;
+    e = max(e, 0.0);
+    return mix(e * e / 3.0, (exp((e - c) / a) + b) / 12.0, step(0.5, e));
+}
+
+// BT.2390 EETF on pq values, rolls the source peak off into the target peak
+float bt2390(float e)
+{
+    float e1 = e / src_peak_pq;
+    float maxLum = dst_peak_pq / src_peak_pq;
+    float ks = 1.5 * maxLum - 0.5;
+    if (e1 > ks) {
+        float t = (e1 - ks) / (1.0 - ks);
+        float t2 = t * t;
+        float t3 = t2 * t;
+        e1 = (2.0 * t3 - 3.0 * t2 + 1.0) * ks
+                + (t3 - 2.0 * t2 + t) * (1.0 - ks)
+                + (-2.0 * t3 + 3.0 * t2) * maxLum;
+    }
+    return e1 * src_peak_pq;
+}
+
+vec3 tone_map(vec3 rgb)
+{
+    if (transfer == 0 || tone_mapping == 0) {
+        return rgb;
+    }
+
+    // display light, in parts of 10000 nits
+    vec3 light;
+    if (transfer == 1) {
+        light = pq_eotf(rgb);
+    }
+    else {
+        // hlg ootf for a display of src_peak
+        vec3 scene = hlg_inverse_oetf(rgb);
+        float ys = dot(scene, vec3(0.2627, 0.6780, 0.0593));
+        float gamma = 1.2 + 0.42 * log(src_peak / 1000.0) / log(10.0);
+        light = scene * pow(max(ys, 1e-6), gamma - 1.0) * src_peak / 10000.0;
+    }
+
+    // on the brightest component, so the hue stays
+    float sig = max(max(light.r, light.g), light.b);
+    if (tone_mapping == 2 && sig > 0.0) {
+        float mapped = pq_eotf(vec3(bt2390(pq_inverse_eotf(sig)))).x;
+        light *= mapped / sig;
+    }
+
+    light = gamut_matrix * (light * 10000.0 / dst_peak);
+    return pow(clamp(light, 0.0, 1.0), vec3(1.0 / 2.4));
+}
 
 void main(void)
 {
+    vec3 rgb;
     if (tex_type == 0) {
         vec3 yuv;
         yuv.x = texture2D(tex0, textureOut0).x;
         yuv.y = texture2D(tex1, textureOut1).x;
         yuv.z = texture2D(tex2, textureOut2).x;
-        /*
-         * YCbCr to RGB
-         * R = 1.164*(Y-16)+1.596*(Cr-128)
-         * G = 1.164*(Y-16)-0.392*(Cb-128)-0.813*(Cr-128)
-         * B = 1.164*(Y-16)+2.017*(Cb-128)
-         */
-        vec3 rgb = mat3(1.164, 1.164, 1.164,
-                   0, -0.392, 2.017,
-                   1.596, -0.813, 0) * vec3(yuv.x-0.0625, yuv.y-0.5, yuv.z-0.5);
-        gl_FragColor = vec4(rgb, 1);
+        rgb = yuv2rgb(yuv * sample_scale);
     }
     else if (tex_type == 1) {
-        gl_FragColor = vec4(texture2D(tex0, textureOut0).rgb, 1);
+        rgb = texture2D(tex0, textureOut0).rgb * sample_scale;
+    }
+    else if (tex_type == 2 || tex_type == 3) {
+        // two channel textures sample as (l, l, l, a)
+        vec2 chroma = texture2D(tex1, textureOut1).ra;
+        if (tex_type == 3) {
+            chroma = chroma.yx;
+        }
+        vec3 yuv = vec3(texture2D(tex0, textureOut0).x, chroma);
+        rgb = yuv2rgb(yuv * sample_scale);
+    }
+    else if (tex_type == 4) {
+        rgb.r = texture2D(tex0, textureOut0).x;
+        rgb.g = texture2D(tex1, textureOut1).x;
+        rgb.b = texture2D(tex2, textureOut2).x;
+        rgb *= sample_scale;
+    }
+    else if (tex_type == 5) {
+        rgb = vec3(texture2D(tex0, textureOut0).x * sample_scale);
     }
     else {
         gl_FragColor = vec4(0, 0, 0, 1);
+        return;
     }
+    gl_FragColor = vec4(tone_map(clamp(rgb, 0.0, 1.0)), 1);
 }
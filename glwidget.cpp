@@ -2,6 +2,44 @@
 
 //#define DOUBLE_SCREEN
 
+// not in the GLES 2 headers
+#ifndef GL_UNPACK_ROW_LENGTH
+#define GL_UNPACK_ROW_LENGTH    0x0CF2
+#endif
+#ifndef GL_LUMINANCE16
+#define GL_LUMINANCE16          0x8042
+#endif
+#ifndef GL_LUMINANCE16_ALPHA16
+#define GL_LUMINANCE16_ALPHA16  0x8048
+#endif
+#ifndef GL_RGB16
+#define GL_RGB16                0x8054
+#endif
+#ifndef GL_RGBA16
+#define GL_RGBA16               0x805B
+#endif
+
+// HDR is tone mapped for SDR white at this luminance, in nits
+#define SDR_WHITE_LUMINANCE     203.0
+// peak luminance of HDR frames without metadata, in nits
+#define HDR_DEFAULT_PEAK        1000.0
+
+// linear BT.2020 RGB to BT.709, column-major
+static const float s_bt2020ToBt709[9] = {
+    1.6605, -0.1246, -0.0182,
+    -0.5876, 1.1329, -0.1006,
+    -0.0728, -0.0083, 1.1187,
+};
+
+// SMPTE ST 2084 inverse EOTF, of the luminance in parts of 10000 nits
+static double pqInverseEOTF(double y)
+{
+    const double m1 = 0.1593017578125, m2 = 78.84375;
+    const double c1 = 0.8359375, c2 = 18.8515625, c3 = 18.6875;
+    double p = pow(qMax(y, 0.0), m1);
+    return pow((c1 + c2 * p) / (1.0 + c3 * p), m2);
+}
+
 GLWidget::GLWidget(QWidget *parent)
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
     : QOpenGLWidget(parent)
@@ -16,6 +54,22 @@ GLWidget::GLWidget(QWidget *parent)
     , m_texGrayV(-1)
     , m_texTypeLoc(-1)
     , m_texType(0)
+    , m_sampleScaleLoc(-1)
+    , m_sampleScale(1.0)
+    , m_colorMatrixLoc(-1)
+    , m_colorOffsetLoc(-1)
+    , m_chromaOffsetLoc(-1)
+    , m_transferLoc(-1)
+    , m_sourcePeakLoc(-1)
+    , m_sourcePeakPQLoc(-1)
+    , m_gamutMatrixLoc(-1)
+    , m_toneMappingLoc(-1)
+    , m_toneMapping(TONE_MAPPING_BT2390)
+    , m_hdrPeak(0.0)
+    , m_isFrameUploaded(false)
+    , m_hasUnpackRowLength(false)
+    , m_hasNorm16(false)
+    , m_unsupportedFormat(AV_PIX_FMT_NONE)
     , m_widthScale(1.0)
     , m_heightScale(1.0)
     , m_wPressed(false)
@@ -24,10 +78,18 @@ GLWidget::GLWidget(QWidget *parent)
     , m_xDeviation(0.0)
     , m_yDeviation(0.0)
 {
+    for (int i = 0; i < 3; ++i) {
+        m_texScaleLocs[i] = -1;
+        m_texScales[i] = 1.0;
+    }
 }
 
 GLWidget::~GLWidget()
 {
+    makeCurrent();
+    m_uploader.destroy();
+    doneCurrent();
+
     if (m_pixelBuffer) {
         delete[] m_pixelBuffer;
     }
@@ -46,7 +108,15 @@ void GLWidget::showImage(const QImage &img)
 
 void GLWidget::showVideoFrame(const SPAVFrame &frame)
 {
+    PixelBufferUploader::FrameLayout layout;
+    if (getFrameLayout(frame, layout) && m_uploader.submit(frame, layout)) {
+        // drawn once the copy thread has put it into a pixel buffer
+        return;
+    }
+    m_uploader.cancel();
+
     m_frame = frame;
+    m_isFrameUploaded = false;
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
     update();
@@ -59,6 +129,8 @@ void GLWidget::clear()
 {
     m_img = QImage();
     m_frame.clear();
+    m_isFrameUploaded = false;
+    m_uploader.cancel();
 
 #if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
     update();
@@ -67,6 +139,26 @@ void GLWidget::clear()
 #endif
 }
 
+void GLWidget::setToneMapping(TONE_Mapping mode)
+{
+    if (mode == m_toneMapping) {
+        return;
+    }
+    qDebug() << __PRETTY_FUNCTION__ << "tone mapping:" << mode;
+    m_toneMapping = mode;
+
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
+    update();
+#else
+    updateGL();
+#endif
+}
+
+GLWidget::TONE_Mapping GLWidget::getToneMapping()
+{
+    return m_toneMapping;
+}
+
 void GLWidget::increaseWidth()
 {
     m_widthScale += 0.01;
@@ -187,6 +279,23 @@ void GLWidget::resetYDeviation()
     m_yDeviation = 0.0;
 }
 
+void GLWidget::onFrameCopied()
+{
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
+    update();
+#else
+    updateGL();
+#endif
+}
+
+void GLWidget::onContextAboutToBeDestroyed()
+{
+    // a buffer may still be mapped and written by the copy thread
+    makeCurrent();
+    m_uploader.destroy();
+    doneCurrent();
+}
+
 void GLWidget::mouseDoubleClickEvent(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
@@ -216,6 +325,9 @@ void GLWidget::keyPressEvent(QKeyEvent *event)
 //        qDebug() << __PRETTY_FUNCTION__ << "H key pressed";
         m_sPressed = true;
     }
+    else if (event->key() == Qt::Key_T) {
+        setToneMapping((TONE_Mapping)((m_toneMapping + 1) % (TONE_MAPPING_BT2390 + 1)));
+    }
     else if (event->key() == Qt::Key_Left) {
         decreaseXDeviation();
     }
@@ -286,14 +398,27 @@ void GLWidget::initializeGL()
 
     m_openGLFun->initializeOpenGLFunctions();
 
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    m_hasUnpackRowLength = !context->isOpenGLES() || context->format().majorVersion() >= 3
+            || context->hasExtension("GL_EXT_unpack_subimage");
+    m_hasNorm16 = !context->isOpenGLES();
+
 //    initTexture();
 
     initShader();
+
+    if (m_uploader.init()) {
+        connect(&m_uploader, SIGNAL(copied()), this, SLOT(onFrameCopied()), Qt::UniqueConnection);
+    }
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
+    connect(context(), SIGNAL(aboutToBeDestroyed()), this, SLOT(onContextAboutToBeDestroyed()), Qt::UniqueConnection);
+#endif
 }
 
 void GLWidget::resizeGL(int w, int h)
 {
 //    m_openGLFun->glViewport(0, 0, w, h);
+    emit viewportSizeChanged(QSize(w, h) * devicePixelRatio());
 }
 
 void GLWidget::paintGL()
@@ -301,6 +426,15 @@ void GLWidget::paintGL()
     m_openGLFun->glClearColor(0.0,0.0,0.0,0.0);
     m_openGLFun->glClear(GL_COLOR_BUFFER_BIT);
 
+    SPAVFrame copiedFrame;
+    PixelBufferUploader::FrameLayout layout;
+    if (m_uploader.bindCopied(copiedFrame, layout)) {
+        m_frame = copiedFrame;
+        uploadFrame(layout, true);
+        m_uploader.release();
+        m_isFrameUploaded = true;
+    }
+
     if (!m_img.isNull()) {
 //        QRgb *pd = extractPixelDataFromImage(m_img);
 //        if (!pd) {
@@ -343,286 +477,41 @@ void GLWidget::paintGL()
 //        if (m_frame->linesize[0] < 0) {
 //            m_frame->linesize[0] = -m_frame->linesize[0];
 //        }
-        static char *s_data = new char[4096*2160*4];
-
-        if (m_frame->format == AV_PIX_FMT_YUV420P || m_frame->format == AV_PIX_FMT_YUVJ420P) {
-            setTexType(0);
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-            int yWidth = m_frame->width, yHeight = m_frame->height;
-            int expectYWidth = yWidth % 4 ? (yWidth / 4 * 4 + 4) : yWidth;
-            if (m_frame->linesize[0] > expectYWidth) {
-                for (int i = 0; i < yHeight; ++i) {
-                    memcpy(s_data + i * expectYWidth, m_frame->data[0] + i * m_frame->linesize[0], expectYWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectYWidth, yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[0], yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE1);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex1);
-            int uWidth = m_frame->width / 2, uHeight = m_frame->height / 2;
-            int expectUWidth = uWidth % 4 ? (uWidth / 4 * 4 + 4) : uWidth;
-            if (m_frame->linesize[1] > expectUWidth) {
-                for (int i = 0; i < uHeight; ++i) {
-                    memcpy(s_data + i * expectUWidth, m_frame->data[1] + i * m_frame->linesize[1], expectUWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectUWidth, uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[1], uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[1]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE2);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex2);
-            int vWidth = m_frame->width / 2, vHeight = m_frame->height / 2;
-            int expectVWidth = vWidth % 4 ? (vWidth / 4 * 4 + 4) : vWidth;
-            if (m_frame->linesize[2] > expectVWidth) {
-                for (int i = 0; i < vHeight; ++i) {
-                    memcpy(s_data + i * expectVWidth, m_frame->data[2] + i * m_frame->linesize[2], expectVWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectVWidth, vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[2], vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[2]);
-            }
+        if (m_isFrameUploaded) {
+            // repaint of the same frame, the textures still hold it
         }
-        else if (m_frame->format == AV_PIX_FMT_YUV422P || m_frame->format == AV_PIX_FMT_YUVJ422P) {
-            setTexType(0);
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-            int yWidth = m_frame->width, yHeight = m_frame->height;
-            int expectYWidth = yWidth % 4 ? (yWidth / 4 * 4 + 4) : yWidth;
-            if (m_frame->linesize[0] > expectYWidth) {
-                for (int i = 0; i < yHeight; ++i) {
-                    memcpy(s_data + i * expectYWidth, m_frame->data[0] + i * m_frame->linesize[0], expectYWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectYWidth, yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[0], yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE1);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex1);
-            int uWidth = m_frame->width / 2, uHeight = m_frame->height;
-            int expectUWidth = uWidth % 4 ? (uWidth / 4 * 4 + 4) : uWidth;
-            if (m_frame->linesize[1] > expectUWidth) {
-                for (int i = 0; i < uHeight; ++i) {
-                    memcpy(s_data + i * expectUWidth, m_frame->data[1] + i * m_frame->linesize[1], expectUWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectUWidth, uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[1], uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[1]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE2);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex2);
-            int vWidth = m_frame->width / 2, vHeight = m_frame->height;
-            int expectVWidth = vWidth % 4 ? (vWidth / 4 * 4 + 4) : vWidth;
-            if (m_frame->linesize[2] > expectVWidth) {
-                for (int i = 0; i < vHeight; ++i) {
-                    memcpy(s_data + i * expectVWidth, m_frame->data[2] + i * m_frame->linesize[2], expectVWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectVWidth, vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[2], vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[2]);
-            }
-        }
-        else if (m_frame->format == AV_PIX_FMT_YUV444P || m_frame->format == AV_PIX_FMT_YUVJ444P) {
-            setTexType(0);
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-            int yWidth = m_frame->width, yHeight = m_frame->height;
-            int expectYWidth = yWidth % 4 ? (yWidth / 4 * 4 + 4) : yWidth;
-            if (m_frame->linesize[0] > expectYWidth) {
-                for (int i = 0; i < yHeight; ++i) {
-                    memcpy(s_data + i * expectYWidth, m_frame->data[0] + i * m_frame->linesize[0], expectYWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectYWidth, yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[0], yHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE1);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex1);
-            int uWidth = m_frame->width, uHeight = m_frame->height;
-            int expectUWidth = uWidth % 4 ? (uWidth / 4 * 4 + 4) : uWidth;
-            if (m_frame->linesize[1] > expectUWidth) {
-                for (int i = 0; i < uHeight; ++i) {
-                    memcpy(s_data + i * expectUWidth, m_frame->data[1] + i * m_frame->linesize[1], expectUWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectUWidth, uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[1], uHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[1]);
-            }
-
-            m_openGLFun->glActiveTexture(GL_TEXTURE2);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex2);
-            int vWidth = m_frame->width, vHeight = m_frame->height;
-            int expectVWidth = vWidth % 4 ? (vWidth / 4 * 4 + 4) : vWidth;
-            if (m_frame->linesize[2] > expectVWidth) {
-                for (int i = 0; i < vHeight; ++i) {
-                    memcpy(s_data + i * expectVWidth, m_frame->data[2] + i * m_frame->linesize[2], expectVWidth);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             expectVWidth, vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE,
-                             m_frame->linesize[2], vHeight, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, m_frame->data[2]);
-            }
-        }
-        else if (m_frame->format == AV_PIX_FMT_RGBA) {
-            setTexType(1);
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-
-            int dataPixelBytes = 4, outPixelBytes = 4;
-            int dataWidth = m_frame->linesize[0] / dataPixelBytes, height = m_frame->height;
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
-            if (expectWidth < dataWidth) {
-                for (int i = 0; i < height; ++i) {
-                    memcpy(s_data + i * expectWidth * outPixelBytes,
-                           m_frame->data[0] + i * dataWidth * dataPixelBytes,
-                           expectWidth * outPixelBytes);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, expectWidth, height,
-                             0, GL_RGBA, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dataWidth, height,
-                             0, GL_RGBA, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-        }
-        else if (m_frame->format == AV_PIX_FMT_BGRA) {
-            setTexType(1);
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-
-            int dataPixelBytes = 4, outPixelBytes = 4;
-            int dataWidth = m_frame->linesize[0] / dataPixelBytes, height = m_frame->height;
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
-            if (expectWidth < dataWidth) {
-                for (int i = 0; i < height; ++i) {
-                    memcpy(s_data + i * expectWidth * outPixelBytes,
-                           m_frame->data[0] + i * dataWidth * dataPixelBytes,
-                           expectWidth * outPixelBytes);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, expectWidth, height,
-                             0, GL_BGRA, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, dataWidth, height,
-                             0, GL_BGRA, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-        }
-        else if (m_frame->format == AV_PIX_FMT_RGB24) {
-            setTexType(1);
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-
-            int dataPixelBytes = 3, outPixelBytes = 3;
-            int dataWidth = m_frame->linesize[0] / dataPixelBytes, height = m_frame->height;
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
-            if (expectWidth < dataWidth) {
-                for (int i = 0; i < height; ++i) {
-                    memcpy(s_data + i * expectWidth * outPixelBytes,
-                           m_frame->data[0] + i * dataWidth * dataPixelBytes,
-                           expectWidth * outPixelBytes);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, expectWidth, height,
-                             0, GL_RGB, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, dataWidth, height,
-                             0, GL_RGB, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
-        }
-        else if (m_frame->format == AV_PIX_FMT_BGR24) {
-            setTexType(1);
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-
-            int dataPixelBytes = 3, outPixelBytes = 3;
-            int dataWidth = m_frame->linesize[0] / dataPixelBytes, height = m_frame->height;
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
-            if (expectWidth < dataWidth) {
-                for (int i = 0; i < height; ++i) {
-                    memcpy(s_data + i * expectWidth * outPixelBytes,
-                           m_frame->data[0] + i * dataWidth * dataPixelBytes,
-                           expectWidth * outPixelBytes);
-                }
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, expectWidth, height,
-                             0, GL_BGR, GL_UNSIGNED_BYTE, s_data);
-            }
-            else {
-                m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, dataWidth, height,
-                             0, GL_BGR, GL_UNSIGNED_BYTE, m_frame->data[0]);
-            }
+        else if (getFrameLayout(m_frame, layout)) {
+            uploadFrame(layout, false);
         }
         else if (m_frame->format == AV_PIX_FMT_PAL8) {
-            setTexType(1);
+            setTexType(TEX_RGB);
+            setSampleScale(1.0);
+            setColorimetry(PixelBufferUploader::FrameLayout());
             m_openGLFun->glActiveTexture(GL_TEXTURE0);
             m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
 
-            int dataPixelBytes = 1, outPixelBytes = 4;
-            int dataWidth = m_frame->linesize[0] / dataPixelBytes, height = m_frame->height;
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
+            int outPixelBytes = 4;
+            int width = m_frame->width, height = m_frame->height;
+            m_convertedData.resize(width * height * outPixelBytes);
+            char *data = m_convertedData.data();
             for (int i = 0; i < height; ++i) {
-                for (int j = 0; j < expectWidth; ++j) {
-                    unsigned char *pcolor = m_frame->data[0] + (i * dataWidth + j) * dataPixelBytes;
-                    memcpy(s_data + (i * expectWidth + j) * outPixelBytes, m_frame->data[1] + pcolor[0] * 4, 4);
+                const unsigned char *pcolor = m_frame->data[0] + i * m_frame->linesize[0];
+                for (int j = 0; j < width; ++j) {
+                    memcpy(data + (i * width + j) * outPixelBytes, m_frame->data[1] + pcolor[j] * 4, 4);
                 }
             }
-            m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, expectWidth, height,
-                         0, GL_BGRA, GL_UNSIGNED_BYTE, s_data);
+            setUnpackStore(0, 1);
+            setTextureScale(0, 1.0);
+            uploadTexture(0, GL_RGBA, width, height, GL_BGRA, GL_UNSIGNED_BYTE, data);
         }
-        else if (m_frame->format == AV_PIX_FMT_GBRP) {
-            setTexType(1);
-            m_openGLFun->glActiveTexture(GL_TEXTURE0);
-            m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
-
-            int outPixelBytes = 3;
-            unsigned char *dataR = m_frame->data[2], *dataG = m_frame->data[0], *dataB = m_frame->data[1];
-            int dataRWidth = m_frame->linesize[2], dataGWidth = m_frame->linesize[0], dataBWidth = m_frame->linesize[1];
-            int expectWidth = m_frame->width % 4 ? (m_frame->width / 4 * 4 + 4) : m_frame->width;
-            int height = m_frame->height;
-            for (int i = 0; i < height; ++i) {
-                for (int j = 0; j < expectWidth; ++j) {
-                    s_data[(i * expectWidth + j) * outPixelBytes + 0] = dataR[i * dataRWidth + j];
-                    s_data[(i * expectWidth + j) * outPixelBytes + 1] = dataG[i * dataGWidth + j];
-                    s_data[(i * expectWidth + j) * outPixelBytes + 2] = dataB[i * dataBWidth + j];
-                }
-            }
+        else if (m_frame->format != m_unsupportedFormat) {
+            qDebug() << __PRETTY_FUNCTION__ << "unsupported pixel format:" << av_get_pix_fmt_name((AVPixelFormat)m_frame->format);
+            m_unsupportedFormat = m_frame->format;
+        }
+        m_isFrameUploaded = true;
 
-            m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, expectWidth, height,
-                         0, GL_RGB, GL_UNSIGNED_BYTE, s_data);
+        if (m_toneMappingLoc != -1) {
+            m_openGLFun->glUniform1i(m_toneMappingLoc, m_toneMapping);
         }
 
         // Draw
@@ -641,6 +530,9 @@ void GLWidget::paintGL()
 #endif
     }
 
+    // the next frame gets copied while this one is drawn
+    m_uploader.prepare();
+
     m_openGLFun->glFlush();
 }
 
@@ -867,6 +759,11 @@ void GLWidget::initShader()
 
 
     //Init Texture
+    for (int i = 0; i < 3; ++i) {
+        m_texInfos[i] = TextureInfo();
+    }
+    m_isFrameUploaded = false;
+
     m_openGLFun->glGenTextures(1, &m_tex0);
     m_openGLFun->glBindTexture(GL_TEXTURE_2D, m_tex0);
     m_openGLFun->glTexParameteri(GL_TEXTURE_2D,GL_TEXTURE_MAG_FILTER,GL_LINEAR);
@@ -924,6 +821,32 @@ void GLWidget::initShader()
 
     m_texTypeLoc = m_openGLFun->glGetUniformLocation(p, "tex_type");
     //    qDebug("uniform [tex_type] location: %d", m_texTypeLoc);
+
+    m_texScaleLocs[0] = m_openGLFun->glGetUniformLocation(p, "textureScale0");
+    m_texScaleLocs[1] = m_openGLFun->glGetUniformLocation(p, "textureScale1");
+    m_texScaleLocs[2] = m_openGLFun->glGetUniformLocation(p, "textureScale2");
+    for (int i = 0; i < 3; ++i) {
+        m_texScales[i] = 1.0;
+        m_openGLFun->glUniform1f(m_texScaleLocs[i], 1.0);
+    }
+
+    m_sampleScaleLoc = m_openGLFun->glGetUniformLocation(p, "sample_scale");
+    m_sampleScale = 1.0;
+    m_openGLFun->glUniform1f(m_sampleScaleLoc, 1.0);
+
+    m_colorMatrixLoc = m_openGLFun->glGetUniformLocation(p, "color_matrix");
+    m_colorOffsetLoc = m_openGLFun->glGetUniformLocation(p, "color_offset");
+    m_chromaOffsetLoc = m_openGLFun->glGetUniformLocation(p, "chroma_offset");
+
+    m_transferLoc = m_openGLFun->glGetUniformLocation(p, "transfer");
+    m_sourcePeakLoc = m_openGLFun->glGetUniformLocation(p, "src_peak");
+    m_sourcePeakPQLoc = m_openGLFun->glGetUniformLocation(p, "src_peak_pq");
+    m_gamutMatrixLoc = m_openGLFun->glGetUniformLocation(p, "gamut_matrix");
+    m_toneMappingLoc = m_openGLFun->glGetUniformLocation(p, "tone_mapping");
+    m_openGLFun->glUniform1f(m_openGLFun->glGetUniformLocation(p, "dst_peak"), SDR_WHITE_LUMINANCE);
+    m_openGLFun->glUniform1f(m_openGLFun->glGetUniformLocation(p, "dst_peak_pq"),
+                             pqInverseEOTF(SDR_WHITE_LUMINANCE / 10000.0));
+    setColorimetry(PixelBufferUploader::FrameLayout());
 }
 
 void GLWidget::setTexType(int type)
@@ -938,6 +861,421 @@ void GLWidget::setTexType(int type)
     m_texType = type;
 }
 
+void GLWidget::setSampleScale(float scale)
+{
+    if (scale == m_sampleScale) {
+        return;
+    }
+    if (m_sampleScaleLoc == -1) {
+        return;
+    }
+    m_openGLFun->glUniform1f(m_sampleScaleLoc, scale);
+    m_sampleScale = scale;
+}
+
+void GLWidget::setColorimetry(const PixelBufferUploader::FrameLayout &layout)
+{
+    if (m_colorMatrixLoc != -1) {
+        m_openGLFun->glUniformMatrix3fv(m_colorMatrixLoc, 1, GL_FALSE, layout.colorMatrix);
+    }
+    if (m_colorOffsetLoc != -1) {
+        m_openGLFun->glUniform3fv(m_colorOffsetLoc, 1, layout.colorOffset);
+    }
+    if (m_chromaOffsetLoc != -1) {
+        m_openGLFun->glUniform2fv(m_chromaOffsetLoc, 1, layout.chromaOffset);
+    }
+    if (m_transferLoc != -1) {
+        m_openGLFun->glUniform1i(m_transferLoc, layout.transfer);
+    }
+    if (layout.transfer != TRANSFER_SDR) {
+        m_openGLFun->glUniform1f(m_sourcePeakLoc, layout.sourcePeak);
+        m_openGLFun->glUniform1f(m_sourcePeakPQLoc, pqInverseEOTF(layout.sourcePeak / 10000.0));
+        m_openGLFun->glUniformMatrix3fv(m_gamutMatrixLoc, 1, GL_FALSE, layout.gamutMatrix);
+    }
+}
+
+void GLWidget::setTextureScale(int index, float scale)
+{
+    if (scale == m_texScales[index]) {
+        return;
+    }
+    if (m_texScaleLocs[index] == -1) {
+        return;
+    }
+    m_openGLFun->glUniform1f(m_texScaleLocs[index], scale);
+    m_texScales[index] = scale;
+}
+
+void GLWidget::setUnpackStore(int rowLength, int alignment)
+{
+    if (m_hasUnpackRowLength) {
+        m_openGLFun->glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
+    }
+    m_openGLFun->glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+}
+
+void GLWidget::allocateTexture(int index, GLint internalFormat, GLsizei width, GLsizei height,
+                               GLenum format, GLenum type)
+{
+    // the texture must be bound already, its storage is only reallocated when
+    // the frame geometry or format changes
+    TextureInfo &info = m_texInfos[index];
+    if (info.width == width && info.height == height
+            && info.internalFormat == internalFormat && info.format == format && info.type == type) {
+        return;
+    }
+
+    m_openGLFun->glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, type, 0);
+    info.width = width;
+    info.height = height;
+    info.internalFormat = internalFormat;
+    info.format = format;
+    info.type = type;
+}
+
+void GLWidget::uploadTexture(int index, GLint internalFormat, GLsizei width, GLsizei height,
+                             GLenum format, GLenum type, const GLvoid *data)
+{
+    allocateTexture(index, internalFormat, width, height, format, type);
+    m_openGLFun->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, type, data);
+}
+
+// index is the texture unit, plane the one of the frame
+static PixelBufferUploader::Plane makePlane(const SPAVFrame &frame, int index, int plane, GLenum format,
+                                            int channels, int bytes, int width, int height)
+{
+    static const GLint s_internalFormats[4][2] = {
+        { GL_LUMINANCE, GL_LUMINANCE16 },
+        { GL_LUMINANCE_ALPHA, GL_LUMINANCE16_ALPHA16 },
+        { GL_RGB, GL_RGB16 },
+        { GL_RGBA, GL_RGBA16 },
+    };
+
+    PixelBufferUploader::Plane p;
+    p.index = index;
+    p.internalFormat = s_internalFormats[channels - 1][bytes - 1];
+    p.format = format;
+    p.type = (bytes == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    p.pixelBytes = channels * bytes;
+    p.width = width;
+    p.height = height;
+    p.data = frame->data[plane];
+    p.linesize = frame->linesize[plane];
+    return p;
+}
+
+// the frame's color properties, or what is usual where they are not set
+static void calculateColorimetry(const SPAVFrame &frame, const AVPixFmtDescriptor *desc,
+                                 PixelBufferUploader::FrameLayout &layout)
+{
+    AVColorSpace colorspace = frame->colorspace;
+    if (colorspace == AVCOL_SPC_UNSPECIFIED || colorspace == AVCOL_SPC_RESERVED) {
+        colorspace = (frame->width >= 1280 || frame->height > 576) ? AVCOL_SPC_BT709 : AVCOL_SPC_SMPTE170M;
+    }
+    double kr, kb;
+    switch (colorspace) {
+    case AVCOL_SPC_BT709:
+        kr = 0.2126; kb = 0.0722;
+        break;
+    case AVCOL_SPC_BT2020_NCL:
+    case AVCOL_SPC_BT2020_CL:
+        kr = 0.2627; kb = 0.0593;
+        break;
+    case AVCOL_SPC_SMPTE240M:
+        kr = 0.212; kb = 0.087;
+        break;
+    case AVCOL_SPC_FCC:
+        kr = 0.30; kb = 0.11;
+        break;
+    default:
+        // BT.601
+        kr = 0.299; kb = 0.114;
+        break;
+    }
+    double kg = 1.0 - kr - kb;
+
+    bool isFullRange = frame->color_range == AVCOL_RANGE_JPEG;
+    if (frame->color_range == AVCOL_RANGE_UNSPECIFIED) {
+        switch (frame->format) {
+        case AV_PIX_FMT_YUVJ420P:
+        case AV_PIX_FMT_YUVJ422P:
+        case AV_PIX_FMT_YUVJ444P:
+        case AV_PIX_FMT_YUVJ440P:
+        case AV_PIX_FMT_YUVJ411P:
+            isFullRange = true;
+            break;
+        default:
+            break;
+        }
+    }
+
+    // the samples are normalized to 0..1 of their bit depth
+    int depth = desc->comp[0].depth;
+    double maxValue = (1 << depth) - 1;
+    double unit = (depth >= 8) ? (1 << (depth - 8)) : 1.0 / (1 << (8 - depth));
+    double yScale = 1.0, cScale = 1.0;
+    layout.colorOffset[0] = 0.0;
+    layout.colorOffset[1] = layout.colorOffset[2] = 128 * unit / maxValue;
+    if (!isFullRange) {
+        layout.colorOffset[0] = 16 * unit / maxValue;
+        yScale = maxValue / (219 * unit);
+        cScale = maxValue / (224 * unit);
+    }
+
+    float *m = layout.colorMatrix;
+    m[0] = yScale;                                  m[1] = yScale;                                  m[2] = yScale;
+    m[3] = 0.0;                                     m[4] = -2.0 * kb * (1.0 - kb) / kg * cScale;    m[5] = 2.0 * (1.0 - kb) * cScale;
+    m[6] = 2.0 * (1.0 - kr) * cScale;               m[7] = -2.0 * kr * (1.0 - kr) / kg * cScale;    m[8] = 0.0;
+
+    // the textures put a chroma sample at the center of the luma samples it
+    // covers, move it to where the frame says it was taken
+    AVChromaLocation location = frame->chroma_location;
+    if (location == AVCHROMA_LOC_UNSPECIFIED) {
+        location = isFullRange ? AVCHROMA_LOC_CENTER : AVCHROMA_LOC_LEFT;
+    }
+    int xpos = 0, ypos = 0;
+    layout.chromaOffset[0] = layout.chromaOffset[1] = 0.0;
+    if (av_chroma_location_enum_to_pos(&xpos, &ypos, location) == 0) {
+        if (desc->log2_chroma_w > 0 && frame->width > 0) {
+            double d = xpos / 256.0 + 0.5 - 0.5 * (1 << desc->log2_chroma_w);
+            layout.chromaOffset[0] = -d / frame->width;
+        }
+        if (desc->log2_chroma_h > 0 && frame->height > 0) {
+            double d = ypos / 256.0 + 0.5 - 0.5 * (1 << desc->log2_chroma_h);
+            layout.chromaOffset[1] = -d / frame->height;
+        }
+    }
+}
+
+void GLWidget::calculateTransfer(const SPAVFrame &frame, PixelBufferUploader::FrameLayout &layout)
+{
+    switch (frame->color_trc) {
+    case AVCOL_TRC_SMPTE2084:
+        layout.transfer = TRANSFER_PQ;
+        break;
+    case AVCOL_TRC_ARIB_STD_B67:
+        layout.transfer = TRANSFER_HLG;
+        break;
+    default:
+        layout.transfer = TRANSFER_SDR;
+        m_hdrPeak = 0.0;
+        return;
+    }
+
+    // the metadata usually comes with the key frames only, keep it for the
+    // frames in between
+    double peak = 0.0;
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(55, 60, 100)
+    AVFrameSideData *sideData = av_frame_get_side_data(frame.data(), AV_FRAME_DATA_CONTENT_LIGHT_LEVEL);
+    if (sideData) {
+        const AVContentLightMetadata *lightLevel = (const AVContentLightMetadata*)sideData->data;
+        peak = lightLevel->MaxCLL;
+    }
+#endif
+    if (peak <= 0.0) {
+        AVFrameSideData *sideData = av_frame_get_side_data(frame.data(), AV_FRAME_DATA_MASTERING_DISPLAY_METADATA);
+        if (sideData) {
+            const AVMasteringDisplayMetadata *mastering = (const AVMasteringDisplayMetadata*)sideData->data;
+            if (mastering->has_luminance) {
+                peak = av_q2d(mastering->max_luminance);
+            }
+        }
+    }
+    if (peak > 0.0) {
+        m_hdrPeak = peak;
+    }
+    layout.sourcePeak = (m_hdrPeak > 0.0) ? m_hdrPeak : HDR_DEFAULT_PEAK;
+
+    if (frame->color_primaries == AVCOL_PRI_BT2020) {
+        memcpy(layout.gamutMatrix, s_bt2020ToBt709, sizeof(layout.gamutMatrix));
+    }
+}
+
+bool GLWidget::getFrameLayout(const SPAVFrame &frame, PixelBufferUploader::FrameLayout &layout)
+{
+    layout = PixelBufferUploader::FrameLayout();
+    if (frame.isNull()) {
+        return false;
+    }
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get((AVPixelFormat)frame->format);
+    if (desc == 0) {
+        return false;
+    }
+    // nothing a texture can sample as it is
+    if (desc->flags & (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)) {
+        return false;
+    }
+    // bottom-up planes stay off the buffer and row length uploads
+    for (int i = 0; i < av_pix_fmt_count_planes((AVPixelFormat)frame->format); ++i) {
+        if (frame->linesize[i] <= 0) {
+            return false;
+        }
+    }
+
+    // every component in 8 or 16 bit words, the alpha is left out
+    const AVComponentDescriptor *comp = desc->comp;
+    int colorComponents = desc->nb_components - ((desc->flags & AV_PIX_FMT_FLAG_ALPHA) ? 1 : 0);
+    int bytes = (comp[0].depth + comp[0].shift + 7) / 8;
+    if (bytes != 1 && bytes != 2) {
+        return false;
+    }
+    for (int i = 1; i < colorComponents; ++i) {
+        if ((comp[i].depth + comp[i].shift + 7) / 8 != bytes) {
+            return false;
+        }
+    }
+    if (bytes == 2) {
+        if (!m_hasNorm16) {
+            return false;
+        }
+        if (((desc->flags & AV_PIX_FMT_FLAG_BE) != 0) != (Q_BYTE_ORDER == Q_BIG_ENDIAN)) {
+            return false;
+        }
+    }
+    // 10 bit in the low bits of a 16 bit texel samples as 0..1023/65535
+    layout.sampleScale = (float)((1 << (8 * bytes)) - 1) / (((1 << comp[0].depth) - 1) << comp[0].shift);
+    calculateTransfer(frame, layout);
+
+    bool isRGB = (desc->flags & AV_PIX_FMT_FLAG_RGB) != 0;
+    int width = frame->width, height = frame->height;
+    int chromaWidth = -((-width) >> desc->log2_chroma_w), chromaHeight = -((-height) >> desc->log2_chroma_h);
+
+    if (colorComponents == 1) {
+        if (comp[0].step != bytes) {
+            return false;
+        }
+        layout.texType = TEX_GRAY;
+        layout.planes << makePlane(frame, 0, comp[0].plane, GL_LUMINANCE, 1, bytes, width, height);
+        return true;
+    }
+    if (colorComponents != 3) {
+        return false;
+    }
+    if (!isRGB) {
+        calculateColorimetry(frame, desc, layout);
+    }
+
+    if (comp[0].plane == comp[1].plane && comp[1].plane == comp[2].plane) {
+        // packed, only rgb in byte order can be sampled directly
+        int channels = comp[0].step / bytes;
+        if (!isRGB || comp[0].step % bytes != 0 || (channels != 3 && channels != 4) || comp[1].offset != bytes) {
+            return false;
+        }
+        GLenum format;
+        if (comp[0].offset == 0 && comp[2].offset == 2 * bytes) {
+            format = (channels == 3) ? GL_RGB : GL_RGBA;
+        }
+        else if (comp[2].offset == 0 && comp[0].offset == 2 * bytes) {
+            format = (channels == 3) ? GL_BGR : GL_BGRA;
+        }
+        else {
+            return false;
+        }
+        layout.texType = TEX_RGB;
+        layout.planes << makePlane(frame, 0, comp[0].plane, format, channels, bytes, width, height);
+        return true;
+    }
+
+    if (comp[1].plane == comp[2].plane) {
+        // semi-planar, the chroma pairs go into a two channel texture
+        if (isRGB || comp[0].step != bytes || comp[1].step != 2 * bytes || comp[2].step != 2 * bytes
+                || qAbs(comp[1].offset - comp[2].offset) != bytes) {
+            return false;
+        }
+        layout.texType = (comp[1].offset < comp[2].offset) ? TEX_NV12 : TEX_NV21;
+        layout.planes << makePlane(frame, 0, comp[0].plane, GL_LUMINANCE, 1, bytes, width, height)
+                      << makePlane(frame, 1, comp[1].plane, GL_LUMINANCE_ALPHA, 2, bytes, chromaWidth, chromaHeight);
+        return true;
+    }
+
+    if (comp[0].plane == comp[1].plane || comp[0].plane == comp[2].plane) {
+        return false;
+    }
+    for (int i = 0; i < 3; ++i) {
+        if (comp[i].step != bytes) {
+            return false;
+        }
+    }
+    layout.texType = isRGB ? TEX_RGB_PLANAR : TEX_YUV_PLANAR;
+    // texture unit i holds component i, whatever plane it is on (GBRP)
+    layout.planes << makePlane(frame, 0, comp[0].plane, GL_LUMINANCE, 1, bytes, width, height)
+                  << makePlane(frame, 1, comp[1].plane, GL_LUMINANCE, 1, bytes, chromaWidth, chromaHeight)
+                  << makePlane(frame, 2, comp[2].plane, GL_LUMINANCE, 1, bytes, chromaWidth, chromaHeight);
+    return true;
+}
+
+void GLWidget::uploadFrame(const PixelBufferUploader::FrameLayout &layout, bool fromBuffer)
+{
+    setTexType(layout.texType);
+    setSampleScale(layout.sampleScale);
+    setColorimetry(layout);
+
+    GLuint textures[3] = { m_tex0, m_tex1, m_tex2 };
+    for (int i = 0; i < layout.planes.count(); ++i) {
+        const PixelBufferUploader::Plane &plane = layout.planes[i];
+        m_openGLFun->glActiveTexture(GL_TEXTURE0 + plane.index);
+        m_openGLFun->glBindTexture(GL_TEXTURE_2D, textures[plane.index]);
+
+        const uint8_t *data = plane.data;
+        if (fromBuffer) {
+            // offset into the bound pixel unpack buffer
+            data = reinterpret_cast<const uint8_t*>(static_cast<intptr_t>(plane.offset));
+        }
+        uploadPlane(plane, data);
+    }
+    setUnpackStore(0, 4);
+}
+
+void GLWidget::uploadPlane(const PixelBufferUploader::Plane &plane, const uint8_t *data)
+{
+    // the rows are read where the frame has them, padding and all
+    int rowBytes = plane.width * plane.pixelBytes;
+    int textureWidth = plane.width;
+    int rowLength = 0, alignment = 1;
+    if (plane.linesize < 0) {
+        // bottom-up, no unpack state walks the rows backwards
+        alignment = 0;
+    }
+    else if (plane.linesize != rowBytes) {
+        if (m_hasUnpackRowLength && plane.linesize % plane.pixelBytes == 0) {
+            rowLength = plane.linesize / plane.pixelBytes;
+        }
+        else {
+            alignment = getUnpackAlignment(rowBytes, plane.linesize);
+        }
+    }
+    if (alignment == 0 && plane.linesize > 0 && plane.linesize % plane.pixelBytes == 0) {
+        // the padding goes into the texture, the texture coordinates leave it out
+        textureWidth = plane.linesize / plane.pixelBytes;
+        alignment = 1;
+    }
+    if (alignment == 0) {
+        // no unpack state describes the stride, upload row by row
+        setUnpackStore(0, 1);
+        setTextureScale(plane.index, 1.0);
+        allocateTexture(plane.index, plane.internalFormat, plane.width, plane.height, plane.format, plane.type);
+        for (int i = 0; i < plane.height; ++i) {
+            m_openGLFun->glTexSubImage2D(GL_TEXTURE_2D, 0, 0, i, plane.width, 1,
+                                         plane.format, plane.type, data + i * plane.linesize);
+        }
+        return;
+    }
+
+    setUnpackStore(rowLength, alignment);
+    setTextureScale(plane.index, (float)plane.width / textureWidth);
+    uploadTexture(plane.index, plane.internalFormat, textureWidth, plane.height, plane.format, plane.type, data);
+}
+
+int GLWidget::getUnpackAlignment(int rowBytes, int linesize)
+{
+    for (int alignment = 8; alignment > 1; alignment /= 2) {
+        if ((rowBytes + alignment - 1) / alignment * alignment == linesize) {
+            return alignment;
+        }
+    }
+    return 0;
+}
+
 QRgb *GLWidget::extractPixelDataFromImage(const QImage &img)
 {
     if (img.width() <= 0 || img.height() <= 0) {
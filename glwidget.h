@@ -4,7 +4,13 @@
 #include <QtCore>
 #include <QtOpenGL>
 
+extern "C"
+{
+#include <libavutil/mastering_display_metadata.h>
+}
+
 #include "avdecoder.h"
+#include "pixelbufferuploader.h"
 
 //#undef QT_VERSION
 //#define QT_VERSION 0x050201
@@ -18,6 +24,31 @@ class GLWidget
 //        , public QOpenGLFunctions
 {
     Q_OBJECT
+public:
+    // tex_type of the fragment shader
+    enum TEX_Type {
+        TEX_YUV_PLANAR = 0,
+        TEX_RGB,
+        TEX_NV12,               // chroma interleaved as UV
+        TEX_NV21,               // chroma interleaved as VU
+        TEX_RGB_PLANAR,
+        TEX_GRAY,
+    };
+
+    // transfer of the shader
+    enum TRANSFER_Type {
+        TRANSFER_SDR = 0,
+        TRANSFER_PQ,            // HDR10
+        TRANSFER_HLG,
+    };
+
+    // what is done with HDR frames
+    enum TONE_Mapping {
+        TONE_MAPPING_NONE = 0,  // the signal as it is, washed out
+        TONE_MAPPING_CLIP,      // linear, clipped at SDR white
+        TONE_MAPPING_BT2390,    // BT.2390 roll-off to SDR white
+    };
+
 public:
     GLWidget(QWidget *parent = 0);
     ~GLWidget();
@@ -27,6 +58,9 @@ public slots:
 
     void showVideoFrame(const SPAVFrame &frame);
 
+    void setToneMapping(TONE_Mapping mode);
+    TONE_Mapping getToneMapping();
+
     void clear();
 
     void increaseWidth();
@@ -49,8 +83,14 @@ public slots:
     void decreaseYDeviation();
     void resetYDeviation();
 
+protected slots:
+    void onFrameCopied();
+    void onContextAboutToBeDestroyed();
+
 signals:
     void fullScreenChanged(bool fullScreen);
+    // in device pixels
+    void viewportSizeChanged(QSize size);
 
 protected:
     void mouseDoubleClickEvent(QMouseEvent *event);
@@ -68,9 +108,39 @@ protected:
     void initTexture();
     void initShader();
     void setTexType(int type);
+    void setSampleScale(float scale);
+    void setColorimetry(const PixelBufferUploader::FrameLayout &layout);
+    void setTextureScale(int index, float scale);
+    void setUnpackStore(int rowLength, int alignment);
+    // (re)allocate the bound texture m_tex<index> if its size or format changes
+    void allocateTexture(int index, GLint internalFormat, GLsizei width, GLsizei height,
+                         GLenum format, GLenum type);
+    // upload a plane into the bound texture m_tex<index>
+    void uploadTexture(int index, GLint internalFormat, GLsizei width, GLsizei height,
+                       GLenum format, GLenum type, const GLvoid *data);
+    // built from the pixel format descriptor, false if the textures cannot
+    // take the planes as they are
+    bool getFrameLayout(const SPAVFrame &frame, PixelBufferUploader::FrameLayout &layout);
+    void calculateTransfer(const SPAVFrame &frame, PixelBufferUploader::FrameLayout &layout);
+    // from the frame, or from the bound pixel buffer if fromBuffer
+    void uploadFrame(const PixelBufferUploader::FrameLayout &layout, bool fromBuffer);
+    void uploadPlane(const PixelBufferUploader::Plane &plane, const uint8_t *data);
+    // GL_UNPACK_ALIGNMENT that steps rows of rowBytes by linesize, 0 if none
+    static int getUnpackAlignment(int rowBytes, int linesize);
     QRgb *extractPixelDataFromImage(const QImage &img);
 
 private:
+    // storage currently allocated for a texture
+    struct TextureInfo {
+        GLsizei width;
+        GLsizei height;
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+
+        TextureInfo() : width(0), height(0), internalFormat(0), format(0), type(0) {}
+    };
+
     QOpenGLFunctions *m_openGLFun;
 
     QImage m_img;
@@ -79,10 +149,29 @@ private:
 
     SPAVFrame m_frame;
     GLuint m_tex0, m_tex1, m_tex2; // Texture id
+    TextureInfo m_texInfos[3];
+    PixelBufferUploader m_uploader;
     uint8_t *m_grayData;
     GLuint m_texGrayU, m_texGrayV;
     GLuint m_texTypeLoc;
     int m_texType;
+    GLint m_sampleScaleLoc;
+    float m_sampleScale;
+    GLint m_colorMatrixLoc, m_colorOffsetLoc, m_chromaOffsetLoc;
+    GLint m_transferLoc, m_sourcePeakLoc, m_sourcePeakPQLoc, m_gamutMatrixLoc, m_toneMappingLoc;
+    TONE_Mapping m_toneMapping;
+    // peak luminance from the metadata of the last HDR frames, 0 if none
+    double m_hdrPeak;
+    // the visible part of the textures, in case the padding is uploaded too
+    GLint m_texScaleLocs[3];
+    float m_texScales[3];
+    bool m_isFrameUploaded;
+    bool m_hasUnpackRowLength;
+    // 16 bit textures for the high bit depth formats
+    bool m_hasNorm16;
+    int m_unsupportedFormat;
+    // PAL8 is converted into this
+    QByteArray m_convertedData;
 
     double m_widthScale, m_heightScale;
     bool m_wPressed, m_hPressed, m_sPressed;
@@ -0,0 +1,79 @@
+#ifndef IOINTERRUPTER_H
+#define IOINTERRUPTER_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+}
+
+#include <QtCore>
+
+// Interrupt callback for libavformat contexts. interrupt() bumps a generation,
+// a context armed with an older generation fails its blocking reads and seeks
+// with AVERROR_EXIT, so a newer request does not wait for stale I/O.
+//
+// Any thread may call interrupt(), arm() belongs to the thread about to call
+// into the context.
+class IOInterrupter
+{
+public:
+    IOInterrupter()
+        : m_source(&m_generation)
+        , m_generation(0)
+        , m_armed(0)
+    {}
+
+    // share the generation of another interrupter, 0 goes back to our own
+    void follow(IOInterrupter *other)
+    {
+        m_source = (other != 0) ? other->m_source : &m_generation;
+        m_armed.store(m_source->load());
+    }
+
+    // must be done before avformat_open_input()
+    void install(AVFormatContext *formatContext)
+    {
+        formatContext->interrupt_callback.callback = callback;
+        formatContext->interrupt_callback.opaque = this;
+    }
+
+    void interrupt()
+    {
+        m_source->fetchAndAddOrdered(1);
+    }
+
+    int getGeneration()
+    {
+        return m_source->loadAcquire();
+    }
+
+    void arm(int generation)
+    {
+        m_armed.storeRelease(generation);
+    }
+
+    void arm()
+    {
+        arm(getGeneration());
+    }
+
+    bool isInterrupted()
+    {
+        return m_armed.loadAcquire() != m_source->loadAcquire();
+    }
+
+protected:
+    static int callback(void *opaque)
+    {
+        return static_cast<IOInterrupter*>(opaque)->isInterrupted() ? 1 : 0;
+    }
+
+private:
+    Q_DISABLE_COPY(IOInterrupter)
+
+    QAtomicInt *m_source;
+    QAtomicInt m_generation;
+    QAtomicInt m_armed;
+};
+
+#endif // IOINTERRUPTER_H
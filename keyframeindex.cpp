@@ -0,0 +1,501 @@
+#include "keyframeindex.h"
+#include "smartmutex.h"
+
+#include <algorithm>
+
+#define KEYFRAME_INDEX_MAGIC    0x4b464958  // "KFIX"
+#define KEYFRAME_INDEX_VERSION  1
+
+static bool entryPtsLessThan(const KeyFrameIndex::Entry &e1, const KeyFrameIndex::Entry &e2)
+{
+    return e1.pts < e2.pts;
+}
+
+KeyFrameIndex::KeyFrameIndex(const QString &file, int streamIndex, AVRational timeBase, QObject *parent)
+    : QObject(parent)
+    , m_file(file)
+    , m_streamIndex(streamIndex)
+    , m_timeBase(timeBase)
+    , m_isComplete(false)
+    , m_currentRange(-1)
+    , m_serial(-1)
+    , m_probeContext(0)
+    , m_taskid(0)
+{
+    moveToThread(&m_thread);
+}
+
+KeyFrameIndex::~KeyFrameIndex()
+{
+    cancel();
+
+    if (m_thread.isRunning()) {
+        m_thread.quit();
+        m_thread.wait();
+    }
+
+    if (m_probeContext != 0) {
+        avformat_close_input(&m_probeContext);
+        avformat_free_context(m_probeContext);
+    }
+}
+
+void KeyFrameIndex::build()
+{
+    if (isComplete()) {
+        return;
+    }
+    if (loadCache()) {
+        qDebug() << __PRETTY_FUNCTION__ << "loaded from cache," << getCount() << "key frames";
+        emit completed();
+        return;
+    }
+
+    if (!m_thread.isRunning()) {
+        m_thread.start(QThread::LowestPriority);
+    }
+    QMetaObject::invokeMethod(this, "scan", Q_ARG(int, m_taskid.fetchAndAddOrdered(1) + 1));
+}
+
+void KeyFrameIndex::cancel()
+{
+    m_taskid.fetchAndAddOrdered(1);
+    m_scanInterrupter.interrupt();
+}
+
+bool KeyFrameIndex::isComplete()
+{
+    SmartMutex mtx(&m_mtx);
+    return m_isComplete;
+}
+
+int KeyFrameIndex::getCount()
+{
+    SmartMutex mtx(&m_mtx);
+    return m_entries.count();
+}
+
+void KeyFrameIndex::addPacket(const AVPacket *packet, int serial)
+{
+    int64_t pts = (packet->pts != AV_NOPTS_VALUE) ? packet->pts : packet->dts;
+    if (pts == AV_NOPTS_VALUE) {
+        return;
+    }
+
+    SmartMutex mtx(&m_mtx);
+    if (m_isComplete) {
+        return;
+    }
+
+    if (serial != m_serial || m_currentRange < 0) {
+        // the demuxer was seeked, this packet is not contiguous with the last one
+        m_serial = serial;
+        m_currentRange = insertRange(pts);
+    }
+    else {
+        Range &r = m_ranges[m_currentRange];
+        r.start = qMin(r.start, pts);
+        r.end = qMax(r.end, pts);
+        m_currentRange = mergeRange(m_currentRange);
+    }
+
+    if (packet->flags & AV_PKT_FLAG_KEY) {
+        insertEntry(Entry(pts, packet->pos, packet->flags));
+    }
+}
+
+bool KeyFrameIndex::findLeft(double t, double &pos)
+{
+    SmartMutex mtx(&m_mtx);
+    if (m_entries.isEmpty()) {
+        return false;
+    }
+
+    int i = lowerBound(t);
+    if (!m_isComplete) {
+        // the key frame must lie in the range around t, otherwise there may
+        // be one in between that has not been demuxed yet
+        int r = findRange(t);
+        if (r < 0) {
+            return false;
+        }
+        int j = (i < m_entries.count() && toSeconds(m_entries[i].pts) == t) ? i : i - 1;
+        if (j < 0 || m_entries[j].pts < m_ranges[r].start) {
+            return false;
+        }
+        pos = toSeconds(m_entries[j].pts);
+        return true;
+    }
+
+    if (i < m_entries.count() && toSeconds(m_entries[i].pts) == t) {
+        pos = t;
+    }
+    else if (i == 0) {
+        // before the first key frame, playback can only start from there
+        pos = toSeconds(m_entries.front().pts);
+    }
+    else {
+        pos = toSeconds(m_entries[i - 1].pts);
+    }
+    return true;
+}
+
+bool KeyFrameIndex::findRight(double t, double &pos)
+{
+    SmartMutex mtx(&m_mtx);
+    if (m_entries.isEmpty()) {
+        return false;
+    }
+
+    int i = lowerBound(t);
+    if (!m_isComplete) {
+        int r = findRange(t);
+        if (r < 0) {
+            return false;
+        }
+        if (i >= m_entries.count() || m_entries[i].pts > m_ranges[r].end) {
+            return false;
+        }
+        pos = toSeconds(m_entries[i].pts);
+        return true;
+    }
+
+    if (i >= m_entries.count()) {
+        pos = toSeconds(m_entries.back().pts);
+    }
+    else {
+        pos = toSeconds(m_entries[i].pts);
+    }
+    return true;
+}
+
+bool KeyFrameIndex::probe(double t, bool left, double &pos)
+{
+    SmartMutex probeMtx(&m_probeMtx);
+    m_probeInterrupter.arm();
+    if (m_probeContext == 0) {
+        // only the demuxer is needed to read packet flags, no decoder is opened
+        AVFormatContext *formatContext = avformat_alloc_context();
+        m_probeInterrupter.install(formatContext);
+        if (avformat_open_input(&formatContext, m_file.toStdString().c_str(), NULL, NULL) < 0) {
+            qDebug() << __PRETTY_FUNCTION__ << "failed to do avformat_open_input";
+            return false;
+        }
+        if (m_streamIndex >= (int)formatContext->nb_streams) {
+            avformat_find_stream_info(formatContext, NULL);
+        }
+        if (m_streamIndex < 0 || m_streamIndex >= (int)formatContext->nb_streams) {
+            avformat_close_input(&formatContext);
+            avformat_free_context(formatContext);
+            return false;
+        }
+        for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+            if ((int)i != m_streamIndex) {
+                formatContext->streams[i]->discard = AVDISCARD_ALL;
+            }
+        }
+        m_probeContext = formatContext;
+    }
+
+    AVRational timeBase = m_probeContext->streams[m_streamIndex]->time_base;
+    AVPacket *avPacket = av_packet_alloc();
+    bool found = false;
+    while (t >= 0.0) {
+        int averr = av_seek_frame(m_probeContext, m_streamIndex, t / av_q2d(timeBase),
+                                  left ? AVSEEK_FLAG_BACKWARD : 0);
+        if (averr < 0) {
+            qDebug() << __PRETTY_FUNCTION__ << "failed to do av_seek_frame" << averr << t << left;
+            break;
+        }
+        while ((averr = av_read_frame(m_probeContext, avPacket)) == 0) {
+            if (avPacket->stream_index == m_streamIndex && (avPacket->flags & AV_PKT_FLAG_KEY)) {
+                int64_t pts = (avPacket->pts != AV_NOPTS_VALUE) ? avPacket->pts : avPacket->dts;
+                if (pts != AV_NOPTS_VALUE) {
+                    pos = av_q2d(timeBase) * pts;
+                    found = true;
+
+                    m_mtx.lock();
+                    if (!m_isComplete) {
+                        insertEntry(Entry(pts, avPacket->pos, avPacket->flags));
+                    }
+                    m_mtx.unlock();
+                }
+            }
+            av_packet_unref(avPacket);
+            if (found) {
+                break;
+            }
+        }
+        if (averr != 0 && averr != AVERROR_EOF) {
+            qDebug() << __PRETTY_FUNCTION__ << "failed to read frame" << averr << t << left;
+            break;
+        }
+        if (found) {
+            break;
+        }
+        // no key frame after t, look from a little earlier
+        t -= 1.0;
+    }
+    av_packet_free(&avPacket);
+    return found;
+}
+
+void KeyFrameIndex::setInterrupter(IOInterrupter *interrupter)
+{
+    SmartMutex probeMtx(&m_probeMtx);
+    m_probeInterrupter.follow(interrupter);
+}
+
+bool KeyFrameIndex::getKeyFramePosList(QList<double> &posList)
+{
+    SmartMutex mtx(&m_mtx);
+    if (!m_isComplete) {
+        return false;
+    }
+    for (int i = 0; i < m_entries.count(); ++i) {
+        posList.append(toSeconds(m_entries[i].pts));
+    }
+    return true;
+}
+
+void KeyFrameIndex::scan(int taskid)
+{
+    if (taskid != m_taskid.load()) {
+        return;
+    }
+
+    QTime t;
+    t.start();
+
+    m_scanInterrupter.arm();
+    AVFormatContext *formatContext = avformat_alloc_context();
+    m_scanInterrupter.install(formatContext);
+    if (avformat_open_input(&formatContext, m_file.toStdString().c_str(), NULL, NULL) < 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "failed to do avformat_open_input";
+        return;
+    }
+    if (m_streamIndex >= (int)formatContext->nb_streams) {
+        if (avformat_find_stream_info(formatContext, NULL) < 0) {
+            qDebug() << __PRETTY_FUNCTION__ << "failed to do avformat_find_stream_info";
+        }
+    }
+    if (m_streamIndex < 0 || m_streamIndex >= (int)formatContext->nb_streams) {
+        avformat_close_input(&formatContext);
+        avformat_free_context(formatContext);
+        return;
+    }
+
+    // only the packet headers of our stream are needed
+    for (unsigned int i = 0; i < formatContext->nb_streams; ++i) {
+        if ((int)i != m_streamIndex) {
+            formatContext->streams[i]->discard = AVDISCARD_ALL;
+        }
+    }
+    AVRational timeBase = formatContext->streams[m_streamIndex]->time_base;
+
+    QVector<Entry> entries;
+    AVPacket *avPacket = av_packet_alloc();
+    int averr = 0;
+    while (taskid == m_taskid.load()) {
+        if ((averr = av_read_frame(formatContext, avPacket)) != 0) {
+            break;
+        }
+        if (avPacket->stream_index == m_streamIndex && (avPacket->flags & AV_PKT_FLAG_KEY)) {
+            int64_t pts = (avPacket->pts != AV_NOPTS_VALUE) ? avPacket->pts : avPacket->dts;
+            if (pts != AV_NOPTS_VALUE) {
+                entries.append(Entry(pts, avPacket->pos, avPacket->flags));
+            }
+        }
+        av_packet_unref(avPacket);
+    }
+    av_packet_free(&avPacket);
+    avformat_close_input(&formatContext);
+    avformat_free_context(formatContext);
+
+    if (taskid != m_taskid.load()) {
+        return;
+    }
+    if (averr != AVERROR_EOF) {
+        qDebug() << __PRETTY_FUNCTION__ << "failed to read frame" << averr;
+        return;
+    }
+
+    std::sort(entries.begin(), entries.end(), entryPtsLessThan);
+
+    m_mtx.lock();
+    m_timeBase = timeBase;
+    m_entries = entries;
+    m_isComplete = true;
+    m_mtx.unlock();
+
+    qDebug() << __PRETTY_FUNCTION__ << entries.count() << "key frames, cost" << t.elapsed() << "ms";
+
+    saveCache();
+    emit completed();
+}
+
+QString KeyFrameIndex::getCacheFile()
+{
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    if (dir.isEmpty()) {
+        return QString();
+    }
+    QFileInfo fi(m_file);
+    QByteArray hash = QCryptographicHash::hash(fi.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+    return QString("%1/keyframes/%2_%3.idx").arg(dir).arg(QString(hash.toHex())).arg(m_streamIndex);
+}
+
+bool KeyFrameIndex::loadCache()
+{
+    QString cacheFile = getCacheFile();
+    if (cacheFile.isEmpty()) {
+        return false;
+    }
+    QFile file(cacheFile);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+
+    QFileInfo fi(m_file);
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+
+    quint32 magic, version;
+    QString path;
+    qint64 size, mtime;
+    qint32 streamIndex, num, den, count;
+    in >> magic >> version >> path >> size >> mtime >> streamIndex >> num >> den >> count;
+    if (in.status() != QDataStream::Ok
+            || magic != KEYFRAME_INDEX_MAGIC
+            || version != KEYFRAME_INDEX_VERSION
+            || path != fi.absoluteFilePath()
+            || size != fi.size()
+            || mtime != fi.lastModified().toMSecsSinceEpoch()
+            || streamIndex != m_streamIndex
+            || num <= 0 || den <= 0 || count < 0
+            || (qint64)count * 20 > file.size()) {
+        return false;
+    }
+
+    QVector<Entry> entries;
+    entries.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        qint64 pts, pos;
+        qint32 flags;
+        in >> pts >> pos >> flags;
+        entries.append(Entry(pts, pos, flags));
+    }
+    if (in.status() != QDataStream::Ok) {
+        return false;
+    }
+
+    SmartMutex mtx(&m_mtx);
+    m_timeBase.num = num;
+    m_timeBase.den = den;
+    m_entries = entries;
+    m_isComplete = true;
+    return true;
+}
+
+bool KeyFrameIndex::saveCache()
+{
+    QString cacheFile = getCacheFile();
+    if (cacheFile.isEmpty()) {
+        return false;
+    }
+    QFileInfo cfi(cacheFile);
+    if (!QDir().mkpath(cfi.absolutePath())) {
+        return false;
+    }
+    QSaveFile file(cacheFile);
+    if (!file.open(QFile::WriteOnly)) {
+        qDebug() << __PRETTY_FUNCTION__ << "cannot open" << cacheFile;
+        return false;
+    }
+
+    QFileInfo fi(m_file);
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+
+    SmartMutex mtx(&m_mtx);
+    out << (quint32)KEYFRAME_INDEX_MAGIC << (quint32)KEYFRAME_INDEX_VERSION
+        << fi.absoluteFilePath() << (qint64)fi.size() << (qint64)fi.lastModified().toMSecsSinceEpoch()
+        << (qint32)m_streamIndex << (qint32)m_timeBase.num << (qint32)m_timeBase.den
+        << (qint32)m_entries.count();
+    for (int i = 0; i < m_entries.count(); ++i) {
+        out << (qint64)m_entries[i].pts << (qint64)m_entries[i].pos << (qint32)m_entries[i].flags;
+    }
+    return file.commit();
+}
+
+void KeyFrameIndex::insertEntry(const KeyFrameIndex::Entry &entry)
+{
+    QVector<Entry>::iterator it = std::lower_bound(m_entries.begin(), m_entries.end(), entry, entryPtsLessThan);
+    if (it != m_entries.end() && it->pts == entry.pts) {
+        return;
+    }
+    m_entries.insert(it, entry);
+}
+
+int KeyFrameIndex::insertRange(int64_t pts)
+{
+    int i = 0;
+    while (i < m_ranges.count() && m_ranges[i].start <= pts) {
+        ++i;
+    }
+    m_ranges.insert(i, Range(pts, pts));
+    return mergeRange(i);
+}
+
+int KeyFrameIndex::mergeRange(int i)
+{
+    while (i + 1 < m_ranges.count() && m_ranges[i + 1].start <= m_ranges[i].end) {
+        m_ranges[i].end = qMax(m_ranges[i].end, m_ranges[i + 1].end);
+        m_ranges.remove(i + 1);
+    }
+    while (i > 0 && m_ranges[i - 1].end >= m_ranges[i].start) {
+        m_ranges[i - 1].start = qMin(m_ranges[i - 1].start, m_ranges[i].start);
+        m_ranges[i - 1].end = qMax(m_ranges[i - 1].end, m_ranges[i].end);
+        m_ranges.remove(i);
+        --i;
+    }
+    return i;
+}
+
+int KeyFrameIndex::findRange(double t)
+{
+    int low = 0, high = m_ranges.count();
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (toSeconds(m_ranges[mid].start) <= t) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    if (low == 0 || toSeconds(m_ranges[low - 1].end) < t) {
+        return -1;
+    }
+    return low - 1;
+}
+
+int KeyFrameIndex::lowerBound(double t)
+{
+    int low = 0, high = m_entries.count();
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (toSeconds(m_entries[mid].pts) < t) {
+            low = mid + 1;
+        }
+        else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+double KeyFrameIndex::toSeconds(int64_t pts)
+{
+    return av_q2d(m_timeBase) * pts;
+}
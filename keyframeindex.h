@@ -0,0 +1,97 @@
+#ifndef KEYFRAMEINDEX_H
+#define KEYFRAMEINDEX_H
+
+extern "C"
+{
+#include <libavformat/avformat.h>
+#include <libavcodec/avcodec.h>
+}
+
+#include <QtCore>
+
+#include "iointerrupter.h"
+
+class KeyFrameIndex : public QObject
+{
+    Q_OBJECT
+public:
+    struct Entry {
+        int64_t pts;
+        int64_t pos;
+        int flags;
+
+        Entry() : pts(AV_NOPTS_VALUE), pos(-1), flags(0) {}
+        Entry(int64_t _pts, int64_t _pos, int _flags) : pts(_pts), pos(_pos), flags(_flags) {}
+    };
+
+    // pts span the player has demuxed without a gap, every key frame inside is known
+    struct Range {
+        int64_t start;
+        int64_t end;
+
+        Range() : start(0), end(0) {}
+        Range(int64_t _start, int64_t _end) : start(_start), end(_end) {}
+    };
+
+public:
+    explicit KeyFrameIndex(const QString &file, int streamIndex, AVRational timeBase, QObject *parent = 0);
+    ~KeyFrameIndex();
+
+    // load the index from the cache, or scan the file in the background
+    void build();
+    void cancel();
+    bool isComplete();
+    int getCount();
+
+    // record a packet read by the player, packets of the same serial are contiguous
+    void addPacket(const AVPacket *packet, int serial);
+
+    // answered from the table, fail if t is not covered yet
+    bool findLeft(double t, double &pos);
+    bool findRight(double t, double &pos);
+    // seek a private demuxer to find the key frame, for what the table cannot answer
+    bool probe(double t, bool left, double &pos);
+    // the probe is aborted whenever this interrupter is
+    void setInterrupter(IOInterrupter *interrupter);
+    bool getKeyFramePosList(QList<double> &posList);
+
+signals:
+    void completed();
+
+protected:
+    Q_INVOKABLE void scan(int taskid);
+
+    QString getCacheFile();
+    bool loadCache();
+    bool saveCache();
+
+    void insertEntry(const Entry &entry);
+    int insertRange(int64_t pts);
+    int mergeRange(int i);
+    int findRange(double t);
+
+    int lowerBound(double t);
+    double toSeconds(int64_t pts);
+
+private:
+    QString m_file;
+    int m_streamIndex;
+    AVRational m_timeBase;
+    QVector<Entry> m_entries;
+    bool m_isComplete;
+
+    QVector<Range> m_ranges;
+    int m_currentRange;
+    int m_serial;
+
+    AVFormatContext *m_probeContext;
+    IOInterrupter m_probeInterrupter;
+    QMutex m_probeMtx;
+
+    QThread m_thread;
+    QAtomicInt m_taskid;
+    IOInterrupter m_scanInterrupter;
+    QMutex m_mtx;
+};
+
+#endif // KEYFRAMEINDEX_H
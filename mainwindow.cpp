@@ -49,6 +49,15 @@ void MainWindow::init()
             this, SLOT(onPlayerPositionChanged(double)));
     connect(&m_player, SIGNAL(videoFrameUpdated(SPAVFrame)),
             this, SLOT(onVideoFrameUpdated(SPAVFrame)));
+    connect(m_player.getVideoPresenter(), SIGNAL(frameReady(SPAVFrame)),
+            this, SLOT(onVideoFrameUpdated(SPAVFrame)));
+#if (QT_VERSION >= QT_VERSION_CHECK(5, 4, 0))
+    // the swaps are the vsyncs the presenter paces the frames to
+    connect(ui->openGLWidget, SIGNAL(frameSwapped()),
+            m_player.getVideoPresenter(), SLOT(reportFrameSwapped()), Qt::DirectConnection);
+#endif
+    connect(ui->openGLWidget, SIGNAL(viewportSizeChanged(QSize)),
+            this, SLOT(onOpenGLWidgetViewportSizeChanged(QSize)));
 }
 
 bool MainWindow::play(const QString &file)
@@ -185,6 +194,11 @@ void MainWindow::onVideoFrameUpdated(const SPAVFrame &frame)
     ui->openGLWidget->showVideoFrame(frame);
 }
 
+void MainWindow::onOpenGLWidgetViewportSizeChanged(const QSize &size)
+{
+    m_player.setVideoViewportSize(size);
+}
+
 void MainWindow::resizeEvent(QResizeEvent *e)
 {
     ui->openGLWidget->setGeometry(0, 0, width(), ui->centralwidget->height() - ui->horizontalSlider->height() - ui->horizontalLayoutWidget->height());
@@ -36,6 +36,7 @@ protected slots:
 
     void onVideoUpdated(QImage img);
     void onVideoFrameUpdated(const SPAVFrame &frame);
+    void onOpenGLWidgetViewportSizeChanged(const QSize &size);
 
 protected:
     void resizeEvent(QResizeEvent *e);
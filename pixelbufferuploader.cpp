@@ -0,0 +1,292 @@
+#include "pixelbufferuploader.h"
+#include "smartmutex.h"
+
+// planes start at this alignment in a buffer
+#define PLANE_ALIGNMENT     64
+
+PixelBufferUploader::PixelBufferUploader(QObject *parent)
+    : QObject(parent)
+    , m_isAvailable(false)
+    , m_mappedIndex(-1)
+    , m_mappedData(0)
+    , m_mappedSize(0)
+    , m_requiredSize(0)
+    , m_boundIndex(-1)
+    , m_nextIndex(0)
+    , m_serial(0)
+    , m_hasPending(false)
+    , m_isCopying(false)
+    , m_hasCopied(false)
+{
+    for (int i = 0; i < PIXEL_BUFFER_COUNT; ++i) {
+        m_buffers[i] = QOpenGLBuffer(QOpenGLBuffer::PixelUnpackBuffer);
+    }
+
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+PixelBufferUploader::~PixelBufferUploader()
+{
+    cancel();
+    m_thread.quit();
+    m_thread.wait();
+}
+
+bool PixelBufferUploader::init()
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (context == 0) {
+        return false;
+    }
+    if (context->isOpenGLES()
+            || (context->format().version() < qMakePair(2, 1)
+                && !context->hasExtension("GL_ARB_pixel_buffer_object"))) {
+        qDebug() << __PRETTY_FUNCTION__ << "pixel unpack buffers are not supported";
+        return false;
+    }
+
+    destroy();
+
+    for (int i = 0; i < PIXEL_BUFFER_COUNT; ++i) {
+        if (!m_buffers[i].create()) {
+            qDebug() << __PRETTY_FUNCTION__ << "cannot create pixel unpack buffer";
+            destroy();
+            return false;
+        }
+        m_buffers[i].setUsagePattern(QOpenGLBuffer::StreamDraw);
+    }
+
+    SmartMutex mtx(&m_mtx);
+    m_isAvailable = true;
+    return true;
+}
+
+void PixelBufferUploader::destroy()
+{
+    SmartMutex mtx(&m_mtx);
+    m_isAvailable = false;
+    ++m_serial;
+    m_hasPending = false;
+    m_pendingFrame.clear();
+    m_pendingLayout = FrameLayout();
+    // the copy thread may still write into the mapped buffer
+    while (m_isCopying) {
+        m_copyCond.wait(&m_mtx);
+    }
+    m_hasCopied = false;
+    m_copiedFrame.clear();
+    m_copiedLayout = FrameLayout();
+
+    if (m_mappedIndex != -1) {
+        m_buffers[m_mappedIndex].bind();
+        m_buffers[m_mappedIndex].unmap();
+        m_buffers[m_mappedIndex].release();
+    }
+    if (m_boundIndex != -1) {
+        m_buffers[m_boundIndex].release();
+    }
+    for (int i = 0; i < PIXEL_BUFFER_COUNT; ++i) {
+        m_buffers[i].destroy();
+    }
+
+    m_mappedIndex = -1;
+    m_mappedData = 0;
+    m_mappedSize = 0;
+    m_requiredSize = 0;
+    m_boundIndex = -1;
+    m_nextIndex = 0;
+}
+
+bool PixelBufferUploader::isAvailable()
+{
+    SmartMutex mtx(&m_mtx);
+    return m_isAvailable;
+}
+
+bool PixelBufferUploader::submit(const SPAVFrame &frame, const FrameLayout &layout)
+{
+    FrameLayout bufferLayout = layout;
+    int size = calculateSize(bufferLayout.planes);
+
+    SmartMutex mtx(&m_mtx);
+    if (!m_isAvailable) {
+        return false;
+    }
+    if (size > m_requiredSize) {
+        m_requiredSize = size;
+    }
+    if (m_mappedIndex == -1 || size > m_mappedSize) {
+        // this one is uploaded directly, an older one must not be drawn after it
+        ++m_serial;
+        m_hasPending = false;
+        m_pendingFrame.clear();
+        m_hasCopied = false;
+        m_copiedFrame.clear();
+        return false;
+    }
+
+    m_hasPending = true;
+    m_pendingFrame = frame;
+    m_pendingLayout = bufferLayout;
+    if (!m_isCopying) {
+        m_isCopying = true;
+        QMetaObject::invokeMethod(this, "doCopy", Qt::QueuedConnection);
+    }
+    return true;
+}
+
+void PixelBufferUploader::cancel()
+{
+    SmartMutex mtx(&m_mtx);
+    ++m_serial;
+    m_hasPending = false;
+    m_pendingFrame.clear();
+    m_hasCopied = false;
+    m_copiedFrame.clear();
+}
+
+bool PixelBufferUploader::bindCopied(SPAVFrame &frame, FrameLayout &layout)
+{
+    SmartMutex mtx(&m_mtx);
+    if (!m_hasCopied || m_isCopying || m_mappedIndex == -1) {
+        return false;
+    }
+
+    QOpenGLBuffer &buffer = m_buffers[m_mappedIndex];
+    buffer.bind();
+    if (!buffer.unmap()) {
+        // the storage got lost, e.g. on a mode switch
+        qDebug() << __PRETTY_FUNCTION__ << "buffer content lost";
+        buffer.release();
+        m_mappedIndex = -1;
+        m_mappedData = 0;
+        m_mappedSize = 0;
+        m_hasCopied = false;
+        m_copiedFrame.clear();
+        return false;
+    }
+
+    m_boundIndex = m_mappedIndex;
+    m_mappedIndex = -1;
+    m_mappedData = 0;
+    m_mappedSize = 0;
+
+    frame = m_copiedFrame;
+    layout = m_copiedLayout;
+    m_hasCopied = false;
+    m_copiedFrame.clear();
+    return true;
+}
+
+void PixelBufferUploader::release()
+{
+    SmartMutex mtx(&m_mtx);
+    if (m_boundIndex == -1) {
+        return;
+    }
+    m_buffers[m_boundIndex].release();
+    m_boundIndex = -1;
+}
+
+void PixelBufferUploader::prepare()
+{
+    SmartMutex mtx(&m_mtx);
+    if (!m_isAvailable || m_requiredSize == 0) {
+        return;
+    }
+    if (m_mappedIndex != -1) {
+        if (m_mappedSize >= m_requiredSize || m_isCopying) {
+            return;
+        }
+        // too small for the frames now, mapped again below at the new size
+        QOpenGLBuffer &mapped = m_buffers[m_mappedIndex];
+        mapped.bind();
+        mapped.unmap();
+        mapped.release();
+        m_mappedIndex = -1;
+        m_mappedData = 0;
+        m_mappedSize = 0;
+        m_hasCopied = false;
+        m_copiedFrame.clear();
+    }
+
+    int index = m_nextIndex;
+    QOpenGLBuffer &buffer = m_buffers[index];
+    buffer.bind();
+    // orphan the old storage, an upload from it may still be running
+    buffer.allocate(m_requiredSize);
+    void *data = buffer.map(QOpenGLBuffer::WriteOnly);
+    buffer.release();
+    if (data == 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "cannot map buffer";
+        return;
+    }
+
+    m_mappedIndex = index;
+    m_mappedData = static_cast<uint8_t*>(data);
+    m_mappedSize = m_requiredSize;
+    m_nextIndex = (index + 1) % PIXEL_BUFFER_COUNT;
+}
+
+void PixelBufferUploader::doCopy()
+{
+    while (1) {
+        SPAVFrame frame;
+        FrameLayout layout;
+        uint8_t *dst;
+        int serial;
+        {
+            SmartMutex mtx(&m_mtx);
+            if (!m_hasPending || m_mappedIndex == -1) {
+                m_isCopying = false;
+                m_copyCond.wakeAll();
+                return;
+            }
+            frame = m_pendingFrame;
+            layout = m_pendingLayout;
+            m_hasPending = false;
+            m_pendingFrame.clear();
+            // about to be overwritten
+            m_hasCopied = false;
+            m_copiedFrame.clear();
+            dst = m_mappedData;
+            serial = m_serial;
+        }
+
+        for (int i = 0; i < layout.planes.count(); ++i) {
+            Plane &plane = layout.planes[i];
+            if (plane.linesize > 0) {
+                memcpy(dst + plane.offset, plane.data, plane.linesize * plane.height);
+                continue;
+            }
+            // bottom-up, the rows go in top-down and the upload reads them so
+            int linesize = -plane.linesize;
+            for (int j = 0; j < plane.height; ++j) {
+                memcpy(dst + plane.offset + j * linesize, plane.data + j * plane.linesize, plane.width * plane.pixelBytes);
+            }
+            plane.linesize = linesize;
+        }
+
+        {
+            SmartMutex mtx(&m_mtx);
+            if (serial != m_serial) {
+                continue;
+            }
+            m_hasCopied = true;
+            m_copiedFrame = frame;
+            m_copiedLayout = layout;
+        }
+        emit copied();
+    }
+}
+
+int PixelBufferUploader::calculateSize(QVector<Plane> &planes)
+{
+    int size = 0;
+    for (int i = 0; i < planes.count(); ++i) {
+        planes[i].offset = size;
+        size += (qAbs(planes[i].linesize) * planes[i].height + PLANE_ALIGNMENT - 1) / PLANE_ALIGNMENT * PLANE_ALIGNMENT;
+    }
+    return size;
+}
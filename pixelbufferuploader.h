@@ -0,0 +1,129 @@
+#ifndef PIXELBUFFERUPLOADER_H
+#define PIXELBUFFERUPLOADER_H
+
+#include <QtCore>
+#include <QtGui>
+
+#include "avdecodercore.h"
+
+// number of pixel unpack buffers, one is filled while the other feeds the draw
+#define PIXEL_BUFFER_COUNT  2
+
+// Double-buffered pixel unpack buffers for the video textures. A frame handed
+// to submit() is copied into a mapped buffer on the copy thread, the GL thread
+// then only unmaps it and lets the driver upload from it while the next buffer
+// gets mapped for the next frame.
+//
+// init(), destroy(), bindCopied(), release() and prepare() need the context
+// current, submit() and cancel() can be called from any thread.
+class PixelBufferUploader : public QObject
+{
+    Q_OBJECT
+public:
+    // one texture of a frame
+    struct Plane {
+        int index;              // texture unit
+        GLint internalFormat;
+        GLenum format;
+        GLenum type;
+        int pixelBytes;
+        int width, height;      // in texels
+        const uint8_t *data;
+        int linesize;           // kept in the buffer, the upload skips the padding
+        int offset;             // in the buffer, once copied
+
+        Plane()
+            : index(0), internalFormat(0), format(0), type(0)
+            , pixelBytes(0), width(0), height(0), data(0), linesize(0), offset(0)
+        {}
+    };
+
+    // how a frame goes into the textures and what the shader makes of them
+    struct FrameLayout {
+        int texType;
+        float sampleScale;      // maps the normalized samples back to 0..1
+        QVector<Plane> planes;
+
+        // YCbCr to RGB, rgb = colorMatrix * (yuv - colorOffset), column-major
+        float colorMatrix[9];
+        float colorOffset[3];
+        // where the chroma samples sit, in parts of the picture size
+        float chromaOffset[2];
+
+        // transfer function of the RGB, for the tone mapping of HDR frames
+        int transfer;
+        float sourcePeak;       // in nits
+        // linear source primaries to BT.709, column-major
+        float gamutMatrix[9];
+
+        FrameLayout() : texType(0), sampleScale(1.0), transfer(0), sourcePeak(0.0)
+        {
+            for (int i = 0; i < 9; ++i) {
+                colorMatrix[i] = (i % 4 == 0) ? 1.0 : 0.0;
+                gamutMatrix[i] = (i % 4 == 0) ? 1.0 : 0.0;
+            }
+            colorOffset[0] = colorOffset[1] = colorOffset[2] = 0.0;
+            chromaOffset[0] = chromaOffset[1] = 0.0;
+        }
+    };
+
+public:
+    explicit PixelBufferUploader(QObject *parent = 0);
+    ~PixelBufferUploader();
+
+    bool init();
+    void destroy();
+    bool isAvailable();
+
+    // false if the frame cannot go through a buffer now, what was submitted
+    // before and not drawn yet is dropped then
+    bool submit(const SPAVFrame &frame, const FrameLayout &layout);
+    void cancel();
+
+    // unmaps and binds the buffer of the newest copied frame, the offsets of
+    // the planes are the pixel pointers to upload from until release()
+    bool bindCopied(SPAVFrame &frame, FrameLayout &layout);
+    void release();
+    // maps the next buffer for the coming frame, call after the upload; a
+    // mapped one smaller than the last frame submitted is mapped again
+    void prepare();
+
+signals:
+    void copied();
+
+protected:
+    Q_INVOKABLE void doCopy();
+
+    static int calculateSize(QVector<Plane> &planes);
+
+private:
+    QOpenGLBuffer m_buffers[PIXEL_BUFFER_COUNT];
+    bool m_isAvailable;
+
+    QThread m_thread;
+    QMutex m_mtx;
+    QWaitCondition m_copyCond;
+
+    // buffer mapped for the copy thread, -1 if none
+    int m_mappedIndex;
+    uint8_t *m_mappedData;
+    int m_mappedSize;
+    // what the largest frame submitted needs
+    int m_requiredSize;
+    // buffer bound by bindCopied(), -1 if none
+    int m_boundIndex;
+    int m_nextIndex;
+    // bumped when what is queued must not be drawn anymore
+    int m_serial;
+
+    bool m_hasPending;
+    SPAVFrame m_pendingFrame;
+    FrameLayout m_pendingLayout;
+    bool m_isCopying;
+
+    bool m_hasCopied;
+    SPAVFrame m_copiedFrame;
+    FrameLayout m_copiedLayout;
+};
+
+#endif // PIXELBUFFERUPLOADER_H
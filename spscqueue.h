@@ -0,0 +1,131 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <QtCore>
+
+// Bounded queue between exactly one producer thread and one consumer thread.
+// Both sides only touch atomic indices, neither ever takes a lock.
+//
+// clear() belongs to the producer side. It only marks what has been pushed so
+// far as dropped, the consumer releases those items the next time it looks at
+// the queue, so a slot the consumer may still be copying is never rewritten.
+template <typename T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue(int capacity)
+        : m_items(0)
+        , m_size(1)
+        , m_head(0)
+        , m_tail(0)
+        , m_clearTo(0)
+    {
+        // a power of two keeps slot indices right when the counters wrap
+        while (m_size < capacity) {
+            m_size <<= 1;
+        }
+        m_items = new T[m_size];
+    }
+
+    ~SpscQueue()
+    {
+        delete[] m_items;
+    }
+
+    int getCapacity()
+    {
+        return m_size;
+    }
+
+    // items the consumer will still get
+    int getCount()
+    {
+        uint tail = (uint)m_tail.loadAcquire();
+        uint head = (uint)m_head.loadAcquire();
+        uint clearTo = (uint)m_clearTo.loadAcquire();
+        if ((int)(clearTo - head) > 0) {
+            head = clearTo;
+        }
+        return (int)(tail - head);
+    }
+
+    bool isEmpty()
+    {
+        return getCount() == 0;
+    }
+
+    // producer side
+
+    // counts cleared items the consumer has not released yet
+    bool isFull()
+    {
+        return (uint)m_tail.load() - (uint)m_head.loadAcquire() >= (uint)m_size;
+    }
+
+    bool push(const T &item)
+    {
+        uint tail = (uint)m_tail.load();
+        if (tail - (uint)m_head.loadAcquire() >= (uint)m_size) {
+            return false;
+        }
+        m_items[tail & (m_size - 1)] = item;
+        m_tail.storeRelease((int)(tail + 1));
+        return true;
+    }
+
+    void clear()
+    {
+        m_clearTo.storeRelease(m_tail.load());
+    }
+
+    // consumer side
+
+    bool front(T &item)
+    {
+        uint head = dropCleared();
+        if (head == (uint)m_tail.loadAcquire()) {
+            return false;
+        }
+        item = m_items[head & (m_size - 1)];
+        return true;
+    }
+
+    bool pop(T &item)
+    {
+        uint head = dropCleared();
+        if (head == (uint)m_tail.loadAcquire()) {
+            return false;
+        }
+        item = m_items[head & (m_size - 1)];
+        m_items[head & (m_size - 1)] = T();
+        m_head.storeRelease((int)(head + 1));
+        return true;
+    }
+
+protected:
+    uint dropCleared()
+    {
+        uint head = (uint)m_head.load();
+        uint clearTo = (uint)m_clearTo.loadAcquire();
+        if ((int)(clearTo - head) <= 0) {
+            return head;
+        }
+        while (head != clearTo) {
+            m_items[head & (m_size - 1)] = T();
+            ++head;
+        }
+        m_head.storeRelease((int)head);
+        return head;
+    }
+
+private:
+    Q_DISABLE_COPY(SpscQueue)
+
+    T *m_items;
+    int m_size;
+    QAtomicInt m_head;
+    QAtomicInt m_tail;
+    QAtomicInt m_clearTo;
+};
+
+#endif // SPSCQUEUE_H
@@ -5,11 +5,17 @@ attribute vec2 textureIn2;
 varying vec2 textureOut0;
 varying vec2 textureOut1;
 varying vec2 textureOut2;
+// part of the texture width that is picture, the rest is line padding
+uniform float textureScale0;
+uniform float textureScale1;
+uniform float textureScale2;
+// chroma siting, moves the chroma planes against the luma one
+uniform vec2 chroma_offset;
 
 void main(void)
 {
     gl_Position = vertexIn;
-    textureOut0 = textureIn0;
-    textureOut1 = textureIn1;
-    textureOut2 = textureIn2;
+    textureOut0 = vec2(textureIn0.x * textureScale0, textureIn0.y);
+    textureOut1 = vec2((textureIn1.x + chroma_offset.x) * textureScale1, textureIn1.y + chroma_offset.y);
+    textureOut2 = vec2((textureIn2.x + chroma_offset.x) * textureScale2, textureIn2.y + chroma_offset.y);
 }
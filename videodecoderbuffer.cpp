@@ -1,14 +1,28 @@
 #include "videodecoderbuffer.h"
 #include "smartmutex.h"
 
+// frames that can be buffered ahead of the video output
+#define VIDEO_BUFFER_CAPACITY   16
+
+// frames behind the clock by more than this make the decoder skip more
+#define SKIP_RAISE_LATENESS     0.1
+// the skip level changes at most once within this time, in ms, so the frames
+// decoded before a change cannot push it further
+#define SKIP_RAISE_INTERVAL     500
+// in time for this long, in ms, lowers the skip level again
+#define SKIP_LOWER_INTERVAL     2000
+
 VideoDecoderBuffer::VideoDecoderBuffer(AVDecoderCore *decoder, int videoStreamIndex, QObject *parent)
     : QObject(parent)
     , m_decoderCore(decoder)
     , m_enabledVideoStreamIndex(videoStreamIndex)
     , m_isDecodeEnd(false)
     , m_isSeeking(false)
+    , m_seekSerial(0)
+    , m_decodeSerial(0)
+    , m_bufferedDatas(VIDEO_BUFFER_CAPACITY)
     , m_bufferMinCount(0)
-    , m_dataMtx(QMutex::Recursive)
+    , m_skipLevel(AVDecoderCore::SKIP_NONE)
     , m_opeMtx(QMutex::Recursive)
 {
     moveToThread(&m_thread);
@@ -58,9 +72,7 @@ void VideoDecoderBuffer::resetDecoder()
     m_decoderCore->seekVideo(m_enabledVideoStreamIndex, 0);
     setDecodeEnd(false);
 
-    m_dataMtx.lock();
     m_bufferedDatas.clear();
-    m_dataMtx.unlock();
     requestDecode();
 }
 
@@ -69,7 +81,6 @@ bool VideoDecoderBuffer::seek(double pos, AVDecoderCore::SEEK_Type type)
     if (!isAvailable()) {
         return false;
     }
-    removeDecodeRequests();
     requestSeekVideo(pos, type);
     return true;
 }
@@ -79,11 +90,19 @@ bool VideoDecoderBuffer::isSeeking()
     return m_isSeeking;
 }
 
+int VideoDecoderBuffer::getSeekSerial()
+{
+    return m_seekSerial.load();
+}
+
 void VideoDecoderBuffer::setBufferMinCount(int count)
 {
     if (count < 0) {
         return;
     }
+    if (count > m_bufferedDatas.getCapacity()) {
+        count = m_bufferedDatas.getCapacity();
+    }
     m_bufferMinCount = count;
     if (!isBuffered()) {
         requestDecode();
@@ -101,8 +120,7 @@ int VideoDecoderBuffer::getBufferCount()
         return 0;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
-    return m_bufferedDatas.count();
+    return m_bufferedDatas.getCount();
 }
 
 bool VideoDecoderBuffer::isBuffered()
@@ -120,7 +138,6 @@ bool VideoDecoderBuffer::hasBufferedData()
         return false;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
     return !m_bufferedDatas.isEmpty();
 }
 
@@ -131,9 +148,9 @@ VideoDecoderBuffer::VideoData VideoDecoderBuffer::getBufferedData()
         return vd;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
-    if (!m_bufferedDatas.isEmpty()) {
-        vd = m_bufferedDatas.front();
+    m_bufferedDatas.front(vd);
+    if (!isBuffered()) {
+        requestDecode();
     }
     return vd;
 }
@@ -145,10 +162,7 @@ VideoDecoderBuffer::VideoData VideoDecoderBuffer::popBufferedData()
         return vd;
     }
 
-    SmartMutex dataMtx(&m_dataMtx);
-    if (!m_bufferedDatas.isEmpty()) {
-        vd = m_bufferedDatas.front();
-        m_bufferedDatas.pop_front();
+    if (m_bufferedDatas.pop(vd)) {
         if (!isBuffered()) {
             requestDecode();
         }
@@ -156,6 +170,43 @@ VideoDecoderBuffer::VideoData VideoDecoderBuffer::popBufferedData()
     return vd;
 }
 
+void VideoDecoderBuffer::reportLateness(double lateness)
+{
+    if (!isAvailable()) {
+        return;
+    }
+    if (!m_skipChangeTime.isValid()) {
+        m_skipChangeTime.start();
+        m_lateTime.start();
+    }
+
+    AVDecoderCore::SKIP_Level level = m_skipLevel;
+    if (lateness > SKIP_RAISE_LATENESS) {
+        m_lateTime.restart();
+        if (level < AVDecoderCore::SKIP_NON_KEY_FRAMES && m_skipChangeTime.elapsed() >= SKIP_RAISE_INTERVAL) {
+            level = (AVDecoderCore::SKIP_Level)(level + 1);
+        }
+    }
+    else if (level > AVDecoderCore::SKIP_NONE
+             && m_lateTime.elapsed() >= SKIP_LOWER_INTERVAL
+             && m_skipChangeTime.elapsed() >= SKIP_LOWER_INTERVAL) {
+        level = (AVDecoderCore::SKIP_Level)(level - 1);
+    }
+
+    if (level == m_skipLevel) {
+        return;
+    }
+    qDebug() << __PRETTY_FUNCTION__ << "lateness:" << lateness << "skip level:" << m_skipLevel << "->" << level;
+    m_skipLevel = level;
+    m_skipChangeTime.restart();
+    m_decoderCore->setVideoSkipLevel(m_enabledVideoStreamIndex, level);
+}
+
+AVDecoderCore::SKIP_Level VideoDecoderBuffer::getSkipLevel()
+{
+    return m_skipLevel;
+}
+
 void VideoDecoderBuffer::setDecodeEnd(bool isDecodeEnd)
 {
     if (isDecodeEnd == m_isDecodeEnd) {
@@ -176,29 +227,19 @@ void VideoDecoderBuffer::setSeekingState(bool isSeeking)
 void VideoDecoderBuffer::handleRequests()
 {
     while (1) {
-        m_reqMtx.lock();
-        if (m_requestList.isEmpty()) {
-            m_cond.wait(&m_reqMtx);
-            m_reqMtx.unlock();
-            continue;
-        }
-        Request req = m_requestList.front();
-        m_requestList.pop_front();
-        m_reqMtx.unlock();
+        DecoderCommand cmd = m_commands.take();
 
-        switch (req.rid) {
-        case REQUEST_DECODE:
-            doDecode(req.p1);
+        switch (cmd.type) {
+        case DecoderCommand::DECODE:
+            doDecode(cmd.token);
             break;
 
-        case REQUEST_SEEK:
-            doSeek(req.p1.toMap()["pos"].toDouble(), (AVDecoderCore::SEEK_Type)req.p1.toMap()["type"].toInt());
+        case DecoderCommand::SEEK:
+            doSeek(cmd.pos, (AVDecoderCore::SEEK_Type)cmd.seekType, cmd.token);
             break;
 
-        case REQUEST_QUIT:
-            m_reqMtx.lock();
-            m_requestList.clear();
-            m_reqMtx.unlock();
+        case DecoderCommand::QUIT:
+            m_commands.clear();
             return;
 
         default:
@@ -207,57 +248,24 @@ void VideoDecoderBuffer::handleRequests()
     }
 }
 
-void VideoDecoderBuffer::pushRequest(const Request &req)
-{
-    m_reqMtx.lock();
-    m_requestList.push_back(req);
-    m_cond.wakeAll();
-    m_reqMtx.unlock();
-}
-
-void VideoDecoderBuffer::clearRequestList()
-{
-    m_reqMtx.lock();
-    m_requestList.clear();
-    m_reqMtx.unlock();
-}
-
-void VideoDecoderBuffer::removeDecodeRequests()
-{
-    m_reqMtx.lock();
-    for (QList<Request>::iterator it = m_requestList.begin(); it != m_requestList.end(); ) {
-        if (it->rid == REQUEST_DECODE) {
-            it = m_requestList.erase(it);
-        }
-        else {
-            ++it;
-        }
-    }
-    m_reqMtx.unlock();
-}
-
-void VideoDecoderBuffer::requestDecode(QVariant p)
+void VideoDecoderBuffer::requestDecode()
 {
-    Request req(REQUEST_DECODE, p);
-    pushRequest(req);
+    // the consumer calls this after every pop, the queue keeps one at a time
+    m_commands.push(DecoderCommand::decode());
 }
 
 void VideoDecoderBuffer::requestSeekVideo(double pos, AVDecoderCore::SEEK_Type type)
 {
-    QVariantMap vmap;
-    vmap["pos"] = pos;
-    vmap["type"] = type;
-    Request req(REQUEST_SEEK, vmap);
-    pushRequest(req);
+    // while scrubbing only the newest position is still waiting here
+    m_seekSerial.store(m_commands.push(DecoderCommand::seek(m_enabledVideoStreamIndex, pos, type)));
 }
 
 void VideoDecoderBuffer::requestQuit()
 {
-    Request req(REQUEST_QUIT);
-    pushRequest(req);
+    m_commands.push(DecoderCommand::quit());
 }
 
-void VideoDecoderBuffer::doDecode(QVariant p)
+void VideoDecoderBuffer::doDecode(int token)
 {
     if (!isAvailable()) {
         return;
@@ -271,13 +279,21 @@ void VideoDecoderBuffer::doDecode(QVariant p)
 
     SmartMutex opeMtx(&m_opeMtx);
     while (1) {
-        if (isBuffered()) {
+        if (isBuffered() || m_bufferedDatas.isFull()) {
             emit buffered();
             return;
         }
+        // a newer seek is waiting, what we would decode gets dropped anyway
+        if (m_commands.isCanceled(token)) {
+            return;
+        }
 
         SPAVFrame frame;
         int averr = m_decoderCore->getVideoNextFrame(m_enabledVideoStreamIndex, frame);
+        if (averr == AVERROR_EXIT) {
+            // interrupted for a newer seek, not the end of the file
+            return;
+        }
         if (averr != 0) {
             qDebug() <<  __PRETTY_FUNCTION__ << "cannot get next frame";
             setDecodeEnd(true);
@@ -288,15 +304,14 @@ void VideoDecoderBuffer::doDecode(QVariant p)
 
         VideoData vd;
         vd.frame = frame;
+        vd.serial = m_decodeSerial;
         vd.time = m_decoderCore->calculateVideoTimestamp(m_enabledVideoStreamIndex, frame->pts);
         vd.duration = m_decoderCore->calculateVideoTimestamp(m_enabledVideoStreamIndex, frame->pkt_duration);
-        m_dataMtx.lock();
-        m_bufferedDatas.push_back(vd);
-        m_dataMtx.unlock();
+        m_bufferedDatas.push(vd);
     }
 }
 
-void VideoDecoderBuffer::doSeek(double pos, AVDecoderCore::SEEK_Type type)
+void VideoDecoderBuffer::doSeek(double pos, AVDecoderCore::SEEK_Type type, int token)
 {
     if (pos < 0) {
         return;
@@ -305,9 +320,8 @@ void VideoDecoderBuffer::doSeek(double pos, AVDecoderCore::SEEK_Type type)
         return;
     }
 
-    m_dataMtx.lock();
     m_bufferedDatas.clear();
-    m_dataMtx.unlock();
+    m_decodeSerial = token;
 
     setSeekingState(true);
 
@@ -316,8 +330,12 @@ void VideoDecoderBuffer::doSeek(double pos, AVDecoderCore::SEEK_Type type)
     t.start();
     m_decoderCore->seekVideo(m_enabledVideoStreamIndex, pos, type);
     setDecodeEnd(false);
-    doDecode(QVariant());
+    doDecode(token);
     qDebug() << __PRETTY_FUNCTION__  << "cost" << t.elapsed() << "ms";
 
+    // stay seeking if a newer seek is about to run
+    if (m_commands.isCanceled(token)) {
+        return;
+    }
     setSeekingState(false);
 }
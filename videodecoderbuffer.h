@@ -2,6 +2,8 @@
 #define VIDEODECODERBUFFER_H
 
 #include "avdecodercore.h"
+#include "spscqueue.h"
+#include "decodercommandqueue.h"
 
 class VideoDecoderBuffer : public QObject
 {
@@ -10,8 +12,10 @@ public:
     struct VideoData {
         SPAVFrame frame;
         double time, duration;
+        // the seek the frame was decoded after, see getSeekSerial()
+        int serial;
 
-        VideoData() : time(0.0), duration(0.0) {}
+        VideoData() : time(0.0), duration(0.0), serial(0) {}
     };
 
 public:
@@ -24,6 +28,8 @@ public:
 
     bool seek(double pos, AVDecoderCore::SEEK_Type type = AVDecoderCore::SEEK_LEFT_KEY);
     bool isSeeking();
+    // serial of the last seek requested, frames decoded after it carry it
+    int getSeekSerial();
 
     void setBufferMinCount(int count);
     int getBufferMinCount();
@@ -33,53 +39,50 @@ public:
     VideoData getBufferedData();
     VideoData popBufferedData();
 
+    // called by the video output for the frames it shows or drops, with how
+    // far behind the clock they are; the decoder skips work while they are late
+    void reportLateness(double lateness);
+    AVDecoderCore::SKIP_Level getSkipLevel();
+
 signals:
     void seekingStateChanged(bool isSeeking);
     void buffered();
 
 protected:
-    enum REQUEST_ID {
-        REQUEST_DECODE,
-        REQUEST_SEEK,
-        REQUEST_QUIT,
-    };
-
-    struct Request {
-        Request(REQUEST_ID _rid, QVariant _p = QVariant()) : rid(_rid), p1(_p) {}
-        REQUEST_ID rid;
-        QVariant   p1;
-    };
-
     void setDecodeEnd(bool isDecodeEnd);
     void setSeekingState(bool isSeeking);
 
     Q_INVOKABLE void handleRequests();
 
-    void pushRequest(const Request &req);
-    void clearRequestList();
-    void removeDecodeRequests();
-
-    void requestDecode(QVariant p = QVariant());
+    void requestDecode();
     void requestSeekVideo(double pos, AVDecoderCore::SEEK_Type type);
     void requestQuit();
 
-    void doDecode(QVariant p);
-    void doSeek(double pos, AVDecoderCore::SEEK_Type type);
+    // token is the one of the command being run, 0 never gets canceled
+    void doDecode(int token = 0);
+    void doSeek(double pos, AVDecoderCore::SEEK_Type type, int token);
 
 private:
     AVDecoderCore *m_decoderCore;
     int m_enabledVideoStreamIndex;
     bool m_isDecodeEnd;
     bool m_isSeeking;
+    QAtomicInt m_seekSerial;
+    // decode thread only
+    int m_decodeSerial;
 
     QThread m_thread;
-    QList<Request> m_requestList;
+    DecoderCommandQueue m_commands;
 
-    QList<VideoData> m_bufferedDatas;
+    // filled by the decode thread, drained by the thread showing the video
+    SpscQueue<VideoData> m_bufferedDatas;
     int m_bufferMinCount;
 
-    QMutex m_reqMtx, m_dataMtx, m_opeMtx;
-    QWaitCondition m_cond;
+    // owned by the thread reporting the lateness
+    AVDecoderCore::SKIP_Level m_skipLevel;
+    QElapsedTimer m_skipChangeTime, m_lateTime;
+
+    QMutex m_opeMtx;
 };
 
 #endif // VIDEODECODERBUFFER_H
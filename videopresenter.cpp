@@ -0,0 +1,261 @@
+#include "videopresenter.h"
+#include "avclock.h"
+#include "smartmutex.h"
+
+#include <QtGui>
+#include <algorithm>
+
+// when the screen does not tell
+#define DEFAULT_REFRESH_RATE    60.0
+// phases of the last deadlines the cadence is taken from
+#define CADENCE_PHASE_COUNT     16
+// the decision point moves once a phase comes this close, in parts of the interval
+#define CADENCE_MARGIN          0.125
+// of the pacing statistics, in microseconds
+#define STATS_PERIOD            1000000
+
+VideoPresenter::VideoPresenter(QObject *parent)
+    : QObject(parent)
+    , m_interval(1000000.0 / DEFAULT_REFRESH_RATE)
+    , m_vsyncTimer(this)
+    , m_lastVsync(0)
+    , m_nextVsync(0)
+    , m_lastSwap(0)
+    , m_isWaitingSwap(false)
+    , m_threshold(0.5)
+    , m_statsStart(0)
+{
+    qRegisterMetaType<SPAVFrame>("SPAVFrame");
+
+    QScreen *screen = QGuiApplication::primaryScreen();
+    if (screen != 0 && screen->refreshRate() > 1.0) {
+        m_interval = 1000000.0 / screen->refreshRate();
+    }
+
+    connect(&m_vsyncTimer, SIGNAL(timeout()), this, SLOT(onVsyncTimerTimeout()));
+
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+VideoPresenter::~VideoPresenter()
+{
+    // the timer can only be stopped on its thread
+    QMetaObject::invokeMethod(this, "stop", Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void VideoPresenter::push(const SPAVFrame &frame, qint64 deadline, qint64 duration)
+{
+    Item item;
+    item.frame = frame;
+    item.deadline = deadline;
+    item.duration = duration;
+    {
+        SmartMutex mtx(&m_mtx);
+        m_queue.enqueue(item);
+    }
+    QMetaObject::invokeMethod(this, "start", Qt::QueuedConnection);
+}
+
+void VideoPresenter::flush()
+{
+    SmartMutex mtx(&m_mtx);
+    m_queue.clear();
+}
+
+void VideoPresenter::setRefreshRate(double rate)
+{
+    if (rate <= 1.0) {
+        return;
+    }
+    SmartMutex mtx(&m_mtx);
+    m_interval = 1000000.0 / rate;
+}
+
+double VideoPresenter::getRefreshRate()
+{
+    SmartMutex mtx(&m_mtx);
+    return 1000000.0 / m_interval;
+}
+
+VideoPresenter::PacingStats VideoPresenter::getStats()
+{
+    SmartMutex mtx(&m_mtx);
+    return m_lastStats;
+}
+
+void VideoPresenter::reportFrameSwapped()
+{
+    qint64 time = AVClock::getSystemTime();
+    QMetaObject::invokeMethod(this, "handleVsync", Qt::QueuedConnection,
+                              Q_ARG(qint64, time), Q_ARG(bool, true));
+}
+
+void VideoPresenter::onVsyncTimerTimeout()
+{
+    handleVsync(m_nextVsync, false);
+}
+
+void VideoPresenter::start()
+{
+    // a vsync is coming up already
+    if (m_vsyncTimer.isActive()) {
+        return;
+    }
+
+    double interval;
+    {
+        SmartMutex mtx(&m_mtx);
+        interval = m_interval;
+    }
+    // the last vsync on the grid of the ones seen before
+    qint64 now = AVClock::getSystemTime();
+    qint64 vsync = now;
+    if (m_lastVsync > 0 && m_lastVsync <= now) {
+        vsync = m_lastVsync + (qint64)((qint64)((now - m_lastVsync) / interval) * interval);
+    }
+    handleVsync(vsync, false);
+}
+
+void VideoPresenter::stop()
+{
+    m_vsyncTimer.stop();
+}
+
+void VideoPresenter::handleVsync(qint64 time, bool isSwap)
+{
+    double interval;
+    {
+        SmartMutex mtx(&m_mtx);
+        interval = m_interval;
+    }
+
+    if (isSwap) {
+        if (m_lastSwap > 0) {
+            double dt = time - m_lastSwap;
+            int n = qRound(dt / interval);
+            if (n >= 1 && qAbs(dt / n - interval) < interval * CADENCE_MARGIN) {
+                // the swaps block on the vsyncs, they tell the real interval
+                interval += (dt / n - interval) / 16;
+                SmartMutex mtx(&m_mtx);
+                m_interval = interval;
+            }
+        }
+        m_lastSwap = time;
+        m_isWaitingSwap = false;
+    }
+    else if (m_isWaitingSwap) {
+        // the widget has not drawn the frame picked for this vsync
+        ++m_stats.missed;
+        m_isWaitingSwap = false;
+    }
+
+    m_lastVsync = time;
+    updateStats(time);
+    ++m_stats.vsyncs;
+
+    qint64 next = time + (qint64)interval;
+    Item picked;
+    bool hasPicked = false, isEmpty = false;
+    qint64 firstDeadline = 0;
+    {
+        SmartMutex mtx(&m_mtx);
+        while (!m_queue.isEmpty()) {
+            if (m_queue.head().deadline > next + (qint64)(m_threshold * interval)) {
+                break;
+            }
+            if (hasPicked) {
+                ++m_stats.dropped;
+            }
+            else {
+                firstDeadline = m_queue.head().deadline;
+            }
+            picked = m_queue.dequeue();
+            hasPicked = true;
+            updateCadence(picked.deadline, next, interval);
+        }
+        isEmpty = m_queue.isEmpty();
+    }
+
+    if (hasPicked) {
+        // the vsyncs since the first of them was due kept the frame before
+        qint64 late = next - (firstDeadline - (qint64)(m_threshold * interval));
+        m_stats.repeated += (int)(late / interval);
+        ++m_stats.presented;
+        m_isWaitingSwap = true;
+        emit frameReady(picked.frame);
+    }
+
+    if (!hasPicked && isEmpty) {
+        // push() starts again
+        m_vsyncTimer.stop();
+        return;
+    }
+    // the swap should come before, a quarter of the interval late it is missed
+    m_nextVsync = next;
+    m_vsyncTimer.start(m_isWaitingSwap ? next + (qint64)(interval / 4) : next);
+}
+
+void VideoPresenter::updateCadence(qint64 deadline, qint64 vsync, double interval)
+{
+    double phase = (deadline - vsync) / interval;
+    phase -= floor(phase);
+    m_phases.append(phase);
+    if (m_phases.count() > CADENCE_PHASE_COUNT) {
+        m_phases.removeFirst();
+    }
+
+    // kept as long as no phase comes close, so the cadence stays put
+    bool isClose = false;
+    for (int i = 0; i < m_phases.count(); ++i) {
+        double d = qAbs(m_phases[i] - m_threshold);
+        if (qMin(d, 1.0 - d) < CADENCE_MARGIN) {
+            isClose = true;
+            break;
+        }
+    }
+    if (!isClose) {
+        return;
+    }
+
+    // the middle of the widest gap between the phases, going round, e.g.
+    // between the 0 and 0.5 of 24 fps on 60 Hz, which gives a steady 3:2
+    QList<double> phases = m_phases;
+    std::sort(phases.begin(), phases.end());
+    double gap = 0.0, threshold = m_threshold;
+    for (int i = 0; i < phases.count(); ++i) {
+        double from = phases[i];
+        double to = (i + 1 < phases.count()) ? phases[i + 1] : phases[0] + 1.0;
+        if (to - from > gap) {
+            gap = to - from;
+            threshold = from + gap / 2;
+        }
+    }
+    m_threshold = threshold - floor(threshold);
+}
+
+void VideoPresenter::updateStats(qint64 time)
+{
+    if (m_statsStart == 0) {
+        m_statsStart = time;
+        return;
+    }
+    if (time - m_statsStart < STATS_PERIOD) {
+        return;
+    }
+
+    if (m_stats.presented > 0) {
+        qDebug() << __PRETTY_FUNCTION__ << "vsyncs:" << m_stats.vsyncs
+                 << "presented:" << m_stats.presented << "dropped:" << m_stats.dropped
+                 << "repeated:" << m_stats.repeated << "missed:" << m_stats.missed
+                 << "refresh rate:" << getRefreshRate();
+    }
+    {
+        SmartMutex mtx(&m_mtx);
+        m_lastStats = m_stats;
+    }
+    m_stats = PacingStats();
+    m_statsStart = time;
+}
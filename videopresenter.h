@@ -0,0 +1,98 @@
+#ifndef VIDEOPRESENTER_H
+#define VIDEOPRESENTER_H
+
+#include <QtCore>
+
+#include "avdecodercore.h"
+#include "deadlinetimer.h"
+
+// Paces the video frames to the vsyncs of the display. The frames are pushed
+// a little ahead with the system time they are due at, the presenter thread
+// then picks the one for every coming vsync from the frameSwapped() feedback
+// of the widget and the refresh interval, and hands it over with frameReady().
+// Drawing stays with the widget, so a busy GUI thread misses vsyncs but can
+// no longer bunch frames up or change which frame goes with which vsync.
+//
+// push(), flush(), reportFrameSwapped() and the getters can be called from
+// any thread.
+class VideoPresenter : public QObject
+{
+    Q_OBJECT
+public:
+    // pacing of one second
+    struct PacingStats {
+        int vsyncs;
+        int presented;
+        int dropped;            // replaced by a newer one before their vsync
+        int repeated;           // held over a vsync that was due for the next one
+        int missed;             // not drawn by the vsync they were picked for
+
+        PacingStats() : vsyncs(0), presented(0), dropped(0), repeated(0), missed(0) {}
+    };
+
+public:
+    explicit VideoPresenter(QObject *parent = 0);
+    ~VideoPresenter();
+
+    // deadline in microseconds of AVClock::getSystemTime(), duration in microseconds
+    void push(const SPAVFrame &frame, qint64 deadline, qint64 duration);
+    // drops what is not shown yet
+    void flush();
+
+    // of the display, refined from the swaps while presenting
+    void setRefreshRate(double rate);
+    double getRefreshRate();
+
+    PacingStats getStats();
+
+public slots:
+    // connect to the frameSwapped() of the widget with Qt::DirectConnection,
+    // the swap time is taken right away
+    void reportFrameSwapped();
+
+signals:
+    void frameReady(SPAVFrame frame);
+
+protected slots:
+    void onVsyncTimerTimeout();
+
+protected:
+    Q_INVOKABLE void start();
+    Q_INVOKABLE void stop();
+    // picks the frame for the vsync after the one at time
+    Q_INVOKABLE void handleVsync(qint64 time, bool isSwap);
+
+    // places the decision point between the phases of the recent deadlines
+    void updateCadence(qint64 deadline, qint64 vsync, double interval);
+    void updateStats(qint64 time);
+
+private:
+    struct Item {
+        SPAVFrame frame;
+        qint64 deadline, duration;
+    };
+
+    QThread m_thread;
+    QMutex m_mtx;
+
+    // shared, under m_mtx
+    QQueue<Item> m_queue;
+    double m_interval;          // refresh interval, in microseconds
+    PacingStats m_lastStats;
+
+    // presenter thread only
+    DeadlineTimer m_vsyncTimer;
+    qint64 m_lastVsync, m_nextVsync;
+    qint64 m_lastSwap;
+    // a frame was handed over and its swap has not come yet
+    bool m_isWaitingSwap;
+    // a frame goes to the vsync at most this far before its deadline, in parts
+    // of the interval; kept away from the phases of the deadlines so jitter
+    // does not flip a frame between two vsyncs
+    double m_threshold;
+    QList<double> m_phases;
+    PacingStats m_stats;
+    qint64 m_statsStart;
+};
+
+#endif // VIDEOPRESENTER_H